@@ -0,0 +1,192 @@
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include "accumulation_buffer.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+// Checkpoint file identification
+static const char MAGIC[8] = {'P', 'P', 'G', 'S', 'O', 'A', 'C', '2'};
+
+// Rec. 709 luminance weights
+static const vec3 LUMINANCE{0.2126f, 0.7152f, 0.0722f};
+
+AccumulationBuffer::AccumulationBuffer(int width, int height) : width{width}, height{height} {
+  sum.resize((size_t) (width * height));
+  sumSquares.resize((size_t) (width * height));
+  samples.resize((size_t) (width * height));
+}
+
+void AccumulationBuffer::add(int x, int y, const vec3 &color) {
+  auto index = x + y * width;
+  float luminance = dot(color, LUMINANCE);
+  sum[index] += color;
+  sumSquares[index] += luminance * luminance;
+  samples[index]++;
+}
+
+vec3 AccumulationBuffer::getMean(int x, int y) const {
+  auto index = x + y * width;
+  if (samples[index] == 0) return {0, 0, 0};
+  return sum[index] / (float) samples[index];
+}
+
+float AccumulationBuffer::getVariance(int x, int y) const {
+  auto index = x + y * width;
+  auto n = (float) samples[index];
+  if (n < 2) return numeric_limits<float>::infinity();
+  float mean = dot(sum[index], LUMINANCE) / n;
+  float variance = (sumSquares[index] - n * mean * mean) / (n - 1);
+  return std::max(0.0f, variance) / n;
+}
+
+float AccumulationBuffer::getMaxVariance() const {
+  float result = 0;
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      result = std::max(result, getVariance(x, y));
+  return result;
+}
+
+float AccumulationBuffer::getMeanVariance() const {
+  double result = 0;
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      result += getVariance(x, y);
+  return (float) (result / (width * height));
+}
+
+unsigned int AccumulationBuffer::getSamples(int x, int y) const {
+  return samples[x + y * width];
+}
+
+unsigned int AccumulationBuffer::getPasses() const {
+  return passes;
+}
+
+void AccumulationBuffer::nextPass() {
+  passes++;
+}
+
+void AccumulationBuffer::setSettings(const string &settings) {
+  this->settings = settings;
+}
+
+const string &AccumulationBuffer::getSettings() const {
+  return settings;
+}
+
+void AccumulationBuffer::resolve(Image &image) const {
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      vec3 color = clamp(getMean(x, y), 0.0f, 1.0f);
+      image.setPixel(x, y, color.r, color.g, color.b);
+    }
+  }
+}
+
+void AccumulationBuffer::resolve(FloatImage &image) const {
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      image.setPixel(x, y, getMean(x, y));
+}
+
+void AccumulationBuffer::save(const string &checkpoint) const {
+  auto temporary = checkpoint + ".tmp";
+  {
+    ofstream output(temporary, ios::binary);
+    if (!output.is_open()) {
+      stringstream msg;
+      msg << "Could not open checkpoint file for writing. " << checkpoint;
+      throw runtime_error(msg.str());
+    }
+
+    output.write(MAGIC, sizeof(MAGIC));
+    output.write((const char *) &width, sizeof(width));
+    output.write((const char *) &height, sizeof(height));
+    output.write((const char *) &passes, sizeof(passes));
+    auto length = (uint32_t) settings.size();
+    output.write((const char *) &length, sizeof(length));
+    output.write(settings.data(), length);
+    output.write((const char *) sum.data(), sum.size() * sizeof(vec3));
+    output.write((const char *) sumSquares.data(), sumSquares.size() * sizeof(float));
+    output.write((const char *) samples.data(), samples.size() * sizeof(unsigned int));
+
+    if (!output) {
+      stringstream msg;
+      msg << "Could not write checkpoint file. " << checkpoint;
+      throw runtime_error(msg.str());
+    }
+  }
+
+  // Replace the previous checkpoint only once the new one is complete
+  remove(checkpoint.c_str());
+  if (rename(temporary.c_str(), checkpoint.c_str()) != 0) {
+    stringstream msg;
+    msg << "Could not replace checkpoint file. " << checkpoint;
+    throw runtime_error(msg.str());
+  }
+}
+
+AccumulationBuffer AccumulationBuffer::load(const string &checkpoint) {
+  ifstream input(checkpoint, ios::binary);
+  if (!input.is_open()) {
+    stringstream msg;
+    msg << "Could not open checkpoint file. " << checkpoint;
+    throw runtime_error(msg.str());
+  }
+
+  char magic[sizeof(MAGIC)];
+  int width = 0, height = 0;
+  unsigned int passes = 0;
+  uint32_t length = 0;
+  input.read(magic, sizeof(magic));
+  input.read((char *) &width, sizeof(width));
+  input.read((char *) &height, sizeof(height));
+  input.read((char *) &passes, sizeof(passes));
+  input.read((char *) &length, sizeof(length));
+
+  // Settings are a short description, a huge length means a damaged file
+  const uint32_t MAX_SETTINGS = 1 << 16;
+  if (!input || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || width <= 0 || height <= 0 || length > MAX_SETTINGS) {
+    stringstream msg;
+    msg << "File is not a valid checkpoint. " << checkpoint;
+    throw runtime_error(msg.str());
+  }
+
+  // The header must describe exactly the rest of the file, checked before anything is allocated
+  const uint64_t pixelSize = sizeof(vec3) + sizeof(float) + sizeof(unsigned int);
+  auto position = input.tellg();
+  input.seekg(0, ios::end);
+  auto remaining = (uint64_t) (input.tellg() - position);
+  input.seekg(position);
+  if (!input || (uint64_t) width > numeric_limits<uint64_t>::max() / pixelSize / (uint64_t) height ||
+      (uint64_t) width * height > numeric_limits<size_t>::max() / pixelSize ||
+      remaining != length + (uint64_t) width * height * pixelSize) {
+    stringstream msg;
+    msg << "Checkpoint size does not match its header. " << checkpoint;
+    throw runtime_error(msg.str());
+  }
+
+  AccumulationBuffer buffer{width, height};
+  buffer.passes = passes;
+  buffer.settings.resize(length);
+  input.read(&buffer.settings[0], length);
+  input.read((char *) buffer.sum.data(), buffer.sum.size() * sizeof(vec3));
+  input.read((char *) buffer.sumSquares.data(), buffer.sumSquares.size() * sizeof(float));
+  input.read((char *) buffer.samples.data(), buffer.samples.size() * sizeof(unsigned int));
+
+  if (!input) {
+    stringstream msg;
+    msg << "Checkpoint file is truncated. " << checkpoint;
+    throw runtime_error(msg.str());
+  }
+  return buffer;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "image.h"
+#include "image_hdr.h"
+
+namespace ppgso {
+
+  /*!
+   * Floating point buffer that accumulates rendering samples over multiple passes.
+   *
+   * Besides the color sum each pixel keeps the sum of squared luminance so the variance of the pixel estimate
+   * can be used to stop rendering once it converges. The buffer can be saved to and restored from a checkpoint
+   * file so long renders can be interrupted and resumed.
+   */
+  class AccumulationBuffer {
+  public:
+    /*!
+     * Create empty accumulation buffer.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     */
+    AccumulationBuffer(int width, int height);
+
+    /*!
+     * Add a single sample to a pixel.
+     *
+     * @param x - Horizontal coordinate.
+     * @param y - Vertical coordinate.
+     * @param color - Sample color, it is not clamped.
+     */
+    void add(int x, int y, const glm::vec3 &color);
+
+    /*!
+     * Get average of all samples of a pixel.
+     *
+     * @param x - Horizontal coordinate.
+     * @param y - Vertical coordinate.
+     * @return - Mean color of the pixel.
+     */
+    glm::vec3 getMean(int x, int y) const;
+
+    /*!
+     * Get variance of the mean luminance of a pixel, decreases with number of samples.
+     *
+     * @param x - Horizontal coordinate.
+     * @param y - Vertical coordinate.
+     * @return - Variance of the pixel estimate or infinity when less than two samples were taken.
+     */
+    float getVariance(int x, int y) const;
+
+    /*!
+     * Get the highest variance of all pixel estimates.
+     *
+     * @return - Maximal variance.
+     */
+    float getMaxVariance() const;
+
+    /*!
+     * Get the average variance of all pixel estimates, a measure of the image noise.
+     *
+     * @return - Mean variance.
+     */
+    float getMeanVariance() const;
+
+    /*!
+     * Get number of samples accumulated in a pixel.
+     *
+     * @param x - Horizontal coordinate.
+     * @param y - Vertical coordinate.
+     * @return - Number of samples.
+     */
+    unsigned int getSamples(int x, int y) const;
+
+    /*!
+     * Get number of completed passes. Passes are counted by the renderer using nextPass.
+     *
+     * @return - Number of passes.
+     */
+    unsigned int getPasses() const;
+
+    /*!
+     * Mark the current pass as finished.
+     */
+    void nextPass();
+
+    /*!
+     * Set description of the render settings the samples were taken with. It is stored in checkpoints so a render
+     * is only resumed with settings producing compatible samples.
+     *
+     * @param settings - Any text describing the settings.
+     */
+    void setSettings(const std::string &settings);
+
+    /*!
+     * Get description of the render settings the samples were taken with.
+     *
+     * @return - Text set by setSettings or loaded from a checkpoint.
+     */
+    const std::string &getSettings() const;
+
+    /*!
+     * Store the average of each pixel clamped to <0, 1> into an image.
+     *
+     * @param image - Image of the same size to store the result to.
+     */
+    void resolve(Image &image) const;
+
+    /*!
+     * Store the average of each pixel into a floating point image without clamping, for tone mapping or HDR export.
+     *
+     * @param image - Image of the same size to store the result to.
+     */
+    void resolve(FloatImage &image) const;
+
+    /*!
+     * Save the buffer to a checkpoint file. The file is written under a temporary name first so an interrupted
+     * save does not destroy the previous checkpoint.
+     *
+     * @param checkpoint - File name of the checkpoint.
+     */
+    void save(const std::string &checkpoint) const;
+
+    /*!
+     * Load the buffer from a checkpoint file.
+     *
+     * @param checkpoint - File name of the checkpoint.
+     * @return - Loaded buffer.
+     */
+    static AccumulationBuffer load(const std::string &checkpoint);
+
+    int width, height;
+  private:
+    std::vector<glm::vec3> sum;
+    std::vector<float> sumSquares;
+    std::vector<unsigned int> samples;
+    unsigned int passes = 0;
+    std::string settings;
+  };
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace ppgso {
+
+  /*!
+   * Queue with limited capacity connecting threads of a pipeline.
+   * Producers block while the queue is full so a fast stage can not run ahead of a slow one and use up memory.
+   */
+  template<typename T>
+  class BoundedQueue {
+  public:
+    /*!
+     * Create an empty queue.
+     *
+     * @param capacity - Maximum number of items in the queue, at least 1.
+     */
+    explicit BoundedQueue(size_t capacity) : capacity{capacity ? capacity : 1} {}
+
+    /*!
+     * Add an item to the end of the queue, waits while the queue is full.
+     *
+     * @param item - Item to add.
+     * @return - False if the queue was closed and the item was dropped.
+     */
+    bool push(T item) {
+      std::unique_lock<std::mutex> lock{mutex};
+      notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+      if (closed) return false;
+      items.push_back(std::move(item));
+      notEmpty.notify_one();
+      return true;
+    }
+
+    /*!
+     * Take an item from the front of the queue, waits while the queue is empty.
+     *
+     * @param item - Reference to store the item to.
+     * @return - False once the queue is closed and all remaining items were taken.
+     */
+    bool pop(T &item) {
+      std::unique_lock<std::mutex> lock{mutex};
+      notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+      if (items.empty()) return false;
+      item = std::move(items.front());
+      items.pop_front();
+      notFull.notify_one();
+      return true;
+    }
+
+    /*!
+     * Stop accepting items and wake up all waiting threads, items already in the queue can still be taken.
+     */
+    void close() {
+      std::lock_guard<std::mutex> lock{mutex};
+      closed = true;
+      notFull.notify_all();
+      notEmpty.notify_all();
+    }
+
+  private:
+    size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+    bool closed = false;
+  };
+}
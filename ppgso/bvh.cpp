@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <numeric>
+
+#include "bvh.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+// Number of bins used to evaluate the surface area heuristic along each axis
+constexpr int BINS = 16;
+// Cost of traversing an inner node relative to intersecting a single primitive
+constexpr double TRAVERSAL_COST = 1.0;
+// Depth after which nodes are split by primitive count only, keeps the traversal stack bounded
+constexpr int MAX_SAH_DEPTH = 32;
+
+void BVH::build(const vector<BoundingBox> &bounds, unsigned int maxLeafSize) {
+  nodes.clear();
+  indices.resize(bounds.size());
+  iota(indices.begin(), indices.end(), 0);
+  if (bounds.empty()) return;
+
+  vector<dvec3> centers(bounds.size());
+  for (size_t i = 0; i < bounds.size(); ++i)
+    centers[i] = bounds[i].center();
+
+  nodes.reserve(2 * bounds.size());
+  buildNode(bounds, centers, 0, (uint32_t) bounds.size(), std::max(1u, maxLeafSize), 0);
+  nodes.shrink_to_fit();
+}
+
+const vector<BVH::Node> &BVH::getNodes() const {
+  return nodes;
+}
+
+const vector<uint32_t> &BVH::getIndices() const {
+  return indices;
+}
+
+uint32_t BVH::buildNode(const vector<BoundingBox> &bounds, const vector<dvec3> &centers,
+                        uint32_t first, uint32_t count, unsigned int maxLeafSize, int depth) {
+  auto index = (uint32_t) nodes.size();
+  nodes.emplace_back();
+
+  // Bounds of the primitives and of their centers
+  BoundingBox box, centerBox;
+  for (uint32_t i = first; i < first + count; ++i) {
+    box.extend(bounds[indices[i]]);
+    centerBox.extend(centers[indices[i]]);
+  }
+  nodes[index].bounds = box;
+
+  // Evaluate SAH cost for bin boundaries on all axes
+  double bestCost = numeric_limits<double>::infinity();
+  int bestAxis = -1, bestBin = 0;
+  if (count > 1 && depth < MAX_SAH_DEPTH) {
+    for (int axis = 0; axis < 3; ++axis) {
+      double extent = centerBox.max[axis] - centerBox.min[axis];
+      if (extent <= 0) continue;
+      double scale = BINS / extent;
+
+      BoundingBox binBounds[BINS];
+      uint32_t binCount[BINS] = {};
+      for (uint32_t i = first; i < first + count; ++i) {
+        int bin = std::min(BINS - 1, (int) ((centers[indices[i]][axis] - centerBox.min[axis]) * scale));
+        binCount[bin]++;
+        binBounds[bin].extend(bounds[indices[i]]);
+      }
+
+      // Sweep from the right to get area and count of everything right of each boundary
+      double rightArea[BINS];
+      uint32_t rightCount[BINS];
+      BoundingBox accumulated;
+      uint32_t accumulatedCount = 0;
+      for (int bin = BINS - 1; bin > 0; --bin) {
+        accumulated.extend(binBounds[bin]);
+        accumulatedCount += binCount[bin];
+        rightArea[bin] = accumulated.area();
+        rightCount[bin] = accumulatedCount;
+      }
+
+      // Sweep from the left and evaluate the cost of each split
+      accumulated = {};
+      accumulatedCount = 0;
+      for (int bin = 0; bin < BINS - 1; ++bin) {
+        accumulated.extend(binBounds[bin]);
+        accumulatedCount += binCount[bin];
+        if (accumulatedCount == 0 || rightCount[bin + 1] == 0) continue;
+        double cost = accumulatedCount * accumulated.area() + rightCount[bin + 1] * rightArea[bin + 1];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = bin;
+        }
+      }
+    }
+  }
+
+  uint32_t middle;
+  if (bestAxis >= 0) {
+    // Create a leaf when splitting is not expected to pay off
+    double area = box.area();
+    double splitCost = area > 0 ? TRAVERSAL_COST + bestCost / area : TRAVERSAL_COST + count;
+    if (count <= maxLeafSize && splitCost >= count) {
+      nodes[index].offset = first;
+      nodes[index].count = (uint16_t) count;
+      return index;
+    }
+
+    // Partition primitives by the chosen bin boundary
+    double extent = centerBox.max[bestAxis] - centerBox.min[bestAxis];
+    double scale = BINS / extent;
+    auto it = partition(indices.begin() + first, indices.begin() + first + count, [&](uint32_t i) {
+      int bin = std::min(BINS - 1, (int) ((centers[i][bestAxis] - centerBox.min[bestAxis]) * scale));
+      return bin <= bestBin;
+    });
+    middle = (uint32_t) (it - indices.begin());
+  } else if (count <= maxLeafSize) {
+    nodes[index].offset = first;
+    nodes[index].count = (uint16_t) count;
+    return index;
+  } else {
+    // All centers coincide or the tree is too deep, split by count along the widest axis
+    dvec3 extent = box.max - box.min;
+    bestAxis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    middle = first + count / 2;
+    nth_element(indices.begin() + first, indices.begin() + middle, indices.begin() + first + count,
+                [&](uint32_t a, uint32_t b) { return centers[a][bestAxis] < centers[b][bestAxis]; });
+  }
+
+  buildNode(bounds, centers, first, middle - first, maxLeafSize, depth + 1);
+  uint32_t second = buildNode(bounds, centers, middle, first + count - middle, maxLeafSize, depth + 1);
+  nodes[index].offset = second;
+  nodes[index].count = 0;
+  nodes[index].axis = (uint16_t) bestAxis;
+  return index;
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Axis aligned bounding box in double precision
+   */
+  struct BoundingBox {
+    glm::dvec3 min{std::numeric_limits<double>::infinity()};
+    glm::dvec3 max{-std::numeric_limits<double>::infinity()};
+
+    /*!
+     * Grow the box so it contains a point
+     * @param point Point to include
+     */
+    void extend(const glm::dvec3 &point) {
+      min = glm::min(min, point);
+      max = glm::max(max, point);
+    }
+
+    /*!
+     * Grow the box so it contains another box
+     * @param box Box to include
+     */
+    void extend(const BoundingBox &box) {
+      min = glm::min(min, box.min);
+      max = glm::max(max, box.max);
+    }
+
+    /*!
+     * Center point of the box
+     * @return Center of the box
+     */
+    glm::dvec3 center() const {
+      return (min + max) * .5;
+    }
+
+    /*!
+     * Surface area of the box used by the SAH cost function
+     * @return Surface area or 0 for empty boxes
+     */
+    double area() const {
+      glm::dvec3 d = max - min;
+      if (d.x < 0 || d.y < 0 || d.z < 0) return 0;
+      return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+  };
+
+  /*!
+   * Bounding volume hierarchy built using binned surface area heuristic.
+   *
+   * The tree is stored as a flat array of nodes in depth first order, the first child of an inner node
+   * always directly follows its parent so only the index of the second child is stored.
+   * Leaves reference a continuous range of primitives, the order is available in getIndices.
+   */
+  class BVH {
+  public:
+    struct Node {
+      BoundingBox bounds;
+      uint32_t offset;  // First primitive for leaves, second child index for inner nodes
+      uint16_t count;   // Number of primitives in the leaf, 0 for inner nodes
+      uint16_t axis;    // Split axis of inner nodes
+    };
+
+    /*!
+     * Build the hierarchy for a set of primitives
+     * @param bounds Bounding box of each primitive
+     * @param maxLeafSize Maximum number of primitives stored in a single leaf
+     */
+    void build(const std::vector<BoundingBox> &bounds, unsigned int maxLeafSize = 4);
+
+    /*!
+     * Get the flattened nodes, first node is the root
+     * @return Vector of nodes
+     */
+    const std::vector<Node> &getNodes() const;
+
+    /*!
+     * Get the primitive order used by the leaves.
+     * Callers are expected to reorder their primitives accordingly so leaf ranges can be used directly.
+     * @return Vector of original primitive indices
+     */
+    const std::vector<uint32_t> &getIndices() const;
+
+    /*!
+     * Traverse the hierarchy with a ray, nearest children are visited first.
+     * @param origin Ray origin
+     * @param direction Ray direction, does not need to be normalized
+     * @param tMax Maximum distance on the ray, the leaf callback is expected to lower it on hit
+     * @param leaf Callback with signature void(uint32_t first, uint32_t count, double &tMax)
+     */
+    template<typename F>
+    void traverse(const glm::dvec3 &origin, const glm::dvec3 &direction, double &tMax, F &&leaf) const {
+      if (nodes.empty()) return;
+
+      glm::dvec3 invDirection = 1.0 / direction;
+      bool negative[3] = {invDirection.x < 0, invDirection.y < 0, invDirection.z < 0};
+
+      uint32_t stack[64];
+      int top = 0;
+      uint32_t current = 0;
+      while (true) {
+        const Node &node = nodes[current];
+        if (intersect(node.bounds, origin, invDirection, tMax)) {
+          if (node.count > 0) {
+            leaf(node.offset, (uint32_t) node.count, tMax);
+          } else {
+            // Visit the child closer to the ray origin first
+            if (negative[node.axis]) {
+              stack[top++] = current + 1;
+              current = node.offset;
+            } else {
+              stack[top++] = node.offset;
+              current = current + 1;
+            }
+            continue;
+          }
+        }
+        if (top == 0) break;
+        current = stack[--top];
+      }
+    }
+
+  private:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> indices;
+
+    uint32_t buildNode(const std::vector<BoundingBox> &bounds, const std::vector<glm::dvec3> &centers,
+                       uint32_t first, uint32_t count, unsigned int maxLeafSize, int depth);
+
+    /*!
+     * Ray to box slab test
+     */
+    static inline bool intersect(const BoundingBox &box, const glm::dvec3 &origin, const glm::dvec3 &invDirection, double tMax) {
+      glm::dvec3 t0 = (box.min - origin) * invDirection;
+      glm::dvec3 t1 = (box.max - origin) * invDirection;
+      glm::dvec3 tNear = glm::min(t0, t1);
+      glm::dvec3 tFar = glm::max(t0, t1);
+      double enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0));
+      double exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+      return enter <= exit;
+    }
+  };
+}
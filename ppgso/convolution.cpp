@@ -0,0 +1,772 @@
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#include "cpu.h"
+#include "fft.h"
+#include "convolution.h"
+
+#ifdef PPGSO_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace ppgso {
+  namespace convolution {
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Float pixels are used as continuous float arrays");
+
+    // Rows processed by a single task of the thread pool
+    static const int ROWS_PER_TASK = 8;
+
+    Kernel::Kernel(int width, int height, const vector<float> &weights, float factor, float bias)
+        : width{width}, height{height}, factor{factor}, bias{bias}, weights{weights} {
+      if (width <= 0 || height <= 0 || weights.size() != (size_t) width * height) {
+        stringstream msg;
+        msg << "Kernel " << width << "x" << height << " does not match " << weights.size() << " weights";
+        throw runtime_error(msg.str());
+      }
+
+      // Kernel is an outer product when every row is a multiple of the row with the largest weight
+      size_t pivot = 0;
+      for (size_t i = 1; i < weights.size(); ++i)
+        if (abs(weights[i]) > abs(weights[pivot])) pivot = i;
+      float largest = weights[pivot];
+      if (largest == 0) return;
+
+      int px = (int) pivot % width, py = (int) pivot / width;
+      vector<float> h((size_t) width), v((size_t) height);
+      for (int x = 0; x < width; ++x)
+        h[x] = get(x, py);
+      for (int y = 0; y < height; ++y)
+        v[y] = get(px, y) / largest;
+
+      float tolerance = abs(largest) * 1e-6f;
+      for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+          if (abs(v[y] * h[x] - get(x, y)) > tolerance) return;
+
+      horizontal = move(h);
+      vertical = move(v);
+    }
+
+    Kernel Kernel::separable(const vector<float> &horizontal, const vector<float> &vertical, float factor,
+                             float bias) {
+      vector<float> weights;
+      weights.reserve(horizontal.size() * vertical.size());
+      for (auto v : vertical)
+        for (auto h : horizontal)
+          weights.push_back(v * h);
+      return {(int) horizontal.size(), (int) vertical.size(), weights, factor, bias};
+    }
+
+    Kernel Kernel::gaussian(float sigma) {
+      int radius = max((int) ceil(sigma * 3.0f), 1);
+      vector<float> weights((size_t) radius * 2 + 1);
+      float sum = 0;
+      for (int i = -radius; i <= radius; ++i) {
+        weights[i + radius] = exp(-(float) (i * i) / (2.0f * sigma * sigma));
+        sum += weights[i + radius];
+      }
+      for (auto &weight : weights)
+        weight /= sum;
+      return separable(weights, weights);
+    }
+
+    Kernel Kernel::box(int radius) {
+      vector<float> weights((size_t) radius * 2 + 1, 1.0f / (float) (radius * 2 + 1));
+      return separable(weights, weights);
+    }
+
+    float Kernel::get(int x, int y) const {
+      return weights[x + y * width];
+    }
+
+    bool Kernel::isSeparable() const {
+      return !horizontal.empty();
+    }
+
+    const vector<float> &Kernel::getHorizontal() const {
+      return horizontal;
+    }
+
+    const vector<float> &Kernel::getVertical() const {
+      return vertical;
+    }
+
+    vector<int> gaussianBoxes(float sigma, int passes) {
+      vector<int> radii;
+      if (sigma <= 0 || passes <= 0) return radii;
+
+      // Variance of a box of width w is (w * w - 1) / 12, odd widths are picked so the passes add up to sigma
+      float variance = sigma * sigma * 12.0f;
+      auto lower = (int) floor(sqrt(variance / (float) passes + 1.0f));
+      if (lower % 2 == 0) --lower;
+      auto lowerPasses = (int) round((variance - (float) (passes * lower * lower + 4 * passes * lower + 3 * passes))
+                                     / (float) (-4 * lower - 4));
+      for (int i = 0; i < passes; ++i)
+        radii.push_back(((i < lowerPasses ? lower : lower + 2) - 1) / 2);
+      return radii;
+    }
+
+    SummedAreaTable::SummedAreaTable(Image &image)
+        : width{image.width}, height{image.height}, sums((size_t) (image.width + 1) * (image.height + 1) * 3) {
+      // First row and column stay zero so rectangles touching the top left corner need no special case
+      auto stride = (size_t) (width + 1) * 3;
+      for (int y = 0; y < height; ++y) {
+        uint64_t row[3] = {0, 0, 0};
+        auto previous = &sums[y * stride + 3], current = &sums[(y + 1) * stride + 3];
+        auto pixels = &image.getPixel(0, y);
+        for (int x = 0; x < width; ++x) {
+          row[0] += pixels[x].r;
+          row[1] += pixels[x].g;
+          row[2] += pixels[x].b;
+          for (int c = 0; c < 3; ++c)
+            current[x * 3 + c] = previous[x * 3 + c] + row[c];
+        }
+      }
+    }
+
+    glm::dvec3 SummedAreaTable::getSum(int x, int y, int width, int height) const {
+      int x0 = max(x, 0), y0 = max(y, 0);
+      int x1 = min(x + width, this->width), y1 = min(y + height, this->height);
+      if (x0 >= x1 || y0 >= y1) return glm::dvec3{0};
+
+      auto stride = (size_t) (this->width + 1) * 3;
+      auto a = &sums[y1 * stride + x1 * 3], b = &sums[y1 * stride + x0 * 3];
+      auto c = &sums[y0 * stride + x1 * 3], d = &sums[y0 * stride + x0 * 3];
+      return {(double) (a[0] - b[0] - c[0] + d[0]), (double) (a[1] - b[1] - c[1] + d[1]),
+              (double) (a[2] - b[2] - c[2] + d[2])};
+    }
+
+    glm::vec3 SummedAreaTable::getAverage(int x, int y, int width, int height) const {
+      int x0 = max(x, 0), y0 = max(y, 0);
+      int x1 = min(x + width, this->width), y1 = min(y + height, this->height);
+      if (x0 >= x1 || y0 >= y1) return glm::vec3{0};
+      return glm::vec3{getSum(x0, y0, x1 - x0, y1 - y0) / ((double) (x1 - x0) * (y1 - y0) * 255.0)};
+    }
+
+    void SummedAreaTable::blur(Image &target, int radius) const {
+      if (target.width != width || target.height != height) {
+        stringstream msg;
+        msg << "Blurred image " << target.width << "x" << target.height << " does not match the summed image "
+            << width << "x" << height;
+        throw runtime_error(msg.str());
+      }
+
+      int size = radius * 2 + 1;
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+          auto color = getAverage(x - radius, y - radius, size, size) * 255.0f + 0.5f;
+          target.setPixel(x, y, {(uint8_t) color.r, (uint8_t) color.g, (uint8_t) color.b});
+        }
+      }
+    }
+
+    // Position of a sample along an axis of the given size, -1 for samples that are zero
+    static int borderIndex(int i, int size, Border border) {
+      if (i >= 0 && i < size) return i;
+      switch (border) {
+        case Border::Clamp:
+          return i < 0 ? 0 : size - 1;
+        case Border::Mirror: {
+          if (size == 1) return 0;
+          int period = 2 * (size - 1);
+          i %= period;
+          if (i < 0) i += period;
+          return i < size ? i : period - i;
+        }
+        case Border::Wrap:
+          i %= size;
+          return i < 0 ? i + size : i;
+        default:
+          return -1;
+      }
+    }
+
+    // target[i] = (accumulate ? target[i] : 0) + sum of weights[k] * source[i + k * step]
+    using RowFunction = void (*)(float *, const float *, const float *, int, int, size_t, bool);
+
+    // target[i] = sum of weights[k] * rows[k][i]
+    using ColumnFunction = void (*)(float *, const float *const *, const float *, int, size_t);
+
+    static void rowScalar(float *target, const float *source, const float *weights, int taps, int step,
+                          size_t count, bool accumulate) {
+      for (size_t i = 0; i < count; ++i) {
+        float sum = accumulate ? target[i] : 0.0f;
+        for (int k = 0; k < taps; ++k)
+          sum += weights[k] * source[i + k * step];
+        target[i] = sum;
+      }
+    }
+
+    static void columnScalar(float *target, const float *const *rows, const float *weights, int taps, size_t count) {
+      for (size_t i = 0; i < count; ++i) {
+        float sum = 0;
+        for (int k = 0; k < taps; ++k)
+          sum += weights[k] * rows[k][i];
+        target[i] = sum;
+      }
+    }
+
+#ifdef PPGSO_X86
+    // 16 results are kept in two registers while all taps are added, the target is written once
+    PPGSO_TARGET("avx2")
+    static void rowAVX2(float *target, const float *source, const float *weights, int taps, int step,
+                        size_t count, bool accumulate) {
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16) {
+        __m256 a = accumulate ? _mm256_loadu_ps(target + i) : _mm256_setzero_ps();
+        __m256 b = accumulate ? _mm256_loadu_ps(target + i + 8) : _mm256_setzero_ps();
+        const float *tap = source + i;
+        for (int k = 0; k < taps; ++k, tap += step) {
+          __m256 weight = _mm256_broadcast_ss(weights + k);
+          a = _mm256_add_ps(a, _mm256_mul_ps(weight, _mm256_loadu_ps(tap)));
+          b = _mm256_add_ps(b, _mm256_mul_ps(weight, _mm256_loadu_ps(tap + 8)));
+        }
+        _mm256_storeu_ps(target + i, a);
+        _mm256_storeu_ps(target + i + 8, b);
+      }
+      rowScalar(target + i, source + i, weights, taps, step, count - i, accumulate);
+    }
+
+    PPGSO_TARGET("avx2")
+    static void columnAVX2(float *target, const float *const *rows, const float *weights, int taps, size_t count) {
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+        for (int k = 0; k < taps; ++k) {
+          __m256 weight = _mm256_broadcast_ss(weights + k);
+          a = _mm256_add_ps(a, _mm256_mul_ps(weight, _mm256_loadu_ps(rows[k] + i)));
+          b = _mm256_add_ps(b, _mm256_mul_ps(weight, _mm256_loadu_ps(rows[k] + i + 8)));
+        }
+        _mm256_storeu_ps(target + i, a);
+        _mm256_storeu_ps(target + i + 8, b);
+      }
+      for (; i < count; ++i) {
+        float sum = 0;
+        for (int k = 0; k < taps; ++k)
+          sum += weights[k] * rows[k][i];
+        target[i] = sum;
+      }
+    }
+
+    // SSE2 is part of every x86-64 CPU, 32 bit builds check for it
+    PPGSO_TARGET("sse2")
+    static void rowSSE2(float *target, const float *source, const float *weights, int taps, int step,
+                        size_t count, bool accumulate) {
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8) {
+        __m128 a = accumulate ? _mm_loadu_ps(target + i) : _mm_setzero_ps();
+        __m128 b = accumulate ? _mm_loadu_ps(target + i + 4) : _mm_setzero_ps();
+        const float *tap = source + i;
+        for (int k = 0; k < taps; ++k, tap += step) {
+          __m128 weight = _mm_set1_ps(weights[k]);
+          a = _mm_add_ps(a, _mm_mul_ps(weight, _mm_loadu_ps(tap)));
+          b = _mm_add_ps(b, _mm_mul_ps(weight, _mm_loadu_ps(tap + 4)));
+        }
+        _mm_storeu_ps(target + i, a);
+        _mm_storeu_ps(target + i + 4, b);
+      }
+      rowScalar(target + i, source + i, weights, taps, step, count - i, accumulate);
+    }
+
+    PPGSO_TARGET("sse2")
+    static void columnSSE2(float *target, const float *const *rows, const float *weights, int taps, size_t count) {
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_setzero_ps(), b = _mm_setzero_ps();
+        for (int k = 0; k < taps; ++k) {
+          __m128 weight = _mm_set1_ps(weights[k]);
+          a = _mm_add_ps(a, _mm_mul_ps(weight, _mm_loadu_ps(rows[k] + i)));
+          b = _mm_add_ps(b, _mm_mul_ps(weight, _mm_loadu_ps(rows[k] + i + 4)));
+        }
+        _mm_storeu_ps(target + i, a);
+        _mm_storeu_ps(target + i + 4, b);
+      }
+      columnScalar(target + i, rows, weights, taps, count - i);
+    }
+#endif
+
+    // Best implementation supported by the CPU, selected once
+    static RowFunction getRowFunction() {
+#ifdef PPGSO_X86
+      if (cpu::hasAVX2()) return rowAVX2;
+      if (cpu::hasSSE2()) return rowSSE2;
+#endif
+      return rowScalar;
+    }
+
+    static ColumnFunction getColumnFunction() {
+#ifdef PPGSO_X86
+      if (cpu::hasAVX2()) return columnAVX2;
+      if (cpu::hasSSE2()) return columnSSE2;
+#endif
+      return columnScalar;
+    }
+
+    static void convolveRow(float *target, const float *source, const float *weights, int taps, int step,
+                            size_t count, bool accumulate) {
+      static const RowFunction function = getRowFunction();
+      function(target, source, weights, taps, step, count, accumulate);
+    }
+
+    static void convolveColumn(float *target, const float *const *rows, const float *weights, int taps,
+                               size_t count) {
+      static const ColumnFunction function = getColumnFunction();
+      function(target, rows, weights, taps, count);
+    }
+
+    static float *getRow(FloatImage &image, int y) {
+      return (float *) &image.getPixel(0, y);
+    }
+
+    static const float *getRow(const FloatImage &image, int y) {
+      return (const float *) &image.getPixel(0, y);
+    }
+
+    // Bias is added once all taps are summed
+    static void addBias(float *row, float bias, size_t count) {
+      if (bias == 0) return;
+      for (size_t i = 0; i < count; ++i)
+        row[i] += bias;
+    }
+
+    Convolution::Convolution(unsigned int threads) : pool{threads}, rows(pool.getThreadCount()) {}
+
+    unsigned int Convolution::getThreadCount() const {
+      return pool.getThreadCount();
+    }
+
+    const float *Convolution::padRow(const glm::vec3 *row, int width, int left, int right, Border border,
+                                     unsigned int thread) {
+      auto &buffer = rows[thread];
+      buffer.resize((size_t) (left + width + right) * 3);
+      padRow(row, width, left, right, border, buffer.data());
+      return buffer.data();
+    }
+
+    void Convolution::padRow(const glm::vec3 *row, int width, int left, int right, Border border, float *target) {
+      auto pixels = (glm::vec3 *) target;
+      memcpy(pixels + left, row, (size_t) width * sizeof(glm::vec3));
+
+      // Samples outside of the row are copied once so the taps never check the border
+      for (int x = -left; x < 0; ++x) {
+        int sx = borderIndex(x, width, border);
+        pixels[x + left] = sx < 0 ? glm::vec3{0} : row[sx];
+      }
+      for (int x = width; x < width + right; ++x) {
+        int sx = borderIndex(x, width, border);
+        pixels[x + left] = sx < 0 ? glm::vec3{0} : row[sx];
+      }
+    }
+
+    void Convolution::direct(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border) {
+      int left = kernel.width / 2, right = kernel.width - 1 - left, top = kernel.height / 2;
+      vector<float> weights((size_t) kernel.width * kernel.height);
+      for (int y = 0; y < kernel.height; ++y)
+        for (int x = 0; x < kernel.width; ++x)
+          weights[x + y * kernel.width] = kernel.get(x, y) / kernel.factor;
+
+      auto count = (size_t) source.width * 3;
+      auto padded = (size_t) (left + source.width + right) * 3;
+      int tasks = (source.height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+      pool.run((size_t) tasks, [&](size_t task, unsigned int thread) {
+        // Ring of padded rows under the kernel, row r is kept in slot r mod kernel height so moving down by one
+        // output row pads just the one source row entering the window
+        auto &ring = rows[thread];
+        ring.resize(padded * kernel.height);
+        vector<int> slots((size_t) kernel.height, numeric_limits<int>::min());
+
+        int last = min((int) task * ROWS_PER_TASK + ROWS_PER_TASK, source.height);
+        for (int y = (int) task * ROWS_PER_TASK; y < last; ++y) {
+          auto output = getRow(target, y);
+          bool accumulate = false;
+          for (int ky = 0; ky < kernel.height; ++ky) {
+            int sy = borderIndex(y + ky - top, source.height, border);
+            if (sy < 0) continue;
+            int slot = (y + ky) % kernel.height;
+            auto row = &ring[slot * padded];
+            if (slots[slot] != y + ky) {
+              padRow(&source.getPixel(0, sy), source.width, left, right, border, row);
+              slots[slot] = y + ky;
+            }
+            convolveRow(output, row, &weights[ky * kernel.width], kernel.width, 3, count, accumulate);
+            accumulate = true;
+          }
+          if (!accumulate) fill(output, output + count, 0.0f);
+          addBias(output, kernel.bias, count);
+        }
+      });
+    }
+
+    void Convolution::separable(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border) {
+      int left = kernel.width / 2, right = kernel.width - 1 - left, top = kernel.height / 2;
+      auto horizontal = kernel.getHorizontal();
+      auto vertical = kernel.getVertical();
+      for (auto &weight : vertical)
+        weight /= kernel.factor;
+
+      auto count = (size_t) source.width * 3;
+      int tasks = (source.height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+
+      // Horizontal pass of every row to a scratch image
+      auto &rowPass = arena.allocate(source.width, source.height);
+      pool.run((size_t) tasks, [&](size_t task, unsigned int thread) {
+        int last = min((int) task * ROWS_PER_TASK + ROWS_PER_TASK, source.height);
+        for (int y = (int) task * ROWS_PER_TASK; y < last; ++y) {
+          auto row = padRow(&source.getPixel(0, y), source.width, left, right, border, thread);
+          convolveRow(getRow(rowPass, y), row, horizontal.data(), kernel.width, 3, count, false);
+        }
+      });
+
+      // Vertical pass combines whole rows of the horizontal pass
+      pool.run((size_t) tasks, [&](size_t task, unsigned int) {
+        vector<const float *> taps;
+        vector<float> weights;
+        int last = min((int) task * ROWS_PER_TASK + ROWS_PER_TASK, source.height);
+        for (int y = (int) task * ROWS_PER_TASK; y < last; ++y) {
+          taps.clear();
+          weights.clear();
+          for (int ky = 0; ky < kernel.height; ++ky) {
+            int sy = borderIndex(y + ky - top, source.height, border);
+            if (sy < 0) continue;
+            taps.push_back(getRow(rowPass, sy));
+            weights.push_back(vertical[ky]);
+          }
+          auto output = getRow(target, y);
+          convolveColumn(output, taps.data(), weights.data(), (int) taps.size(), count);
+          addBias(output, kernel.bias, count);
+        }
+      });
+    }
+
+    // Longest FFT used for tiles unless the kernel itself is longer, keeps tile buffers in the cache
+    static const size_t MAX_FFT_LENGTH = 512;
+
+    // Cost of copying a value in and out of a transform, in units of one radix 2 stage
+    static const double FFT_OVERHEAD = 4.0;
+
+    // Relative cost of one value in a transform against one multiply-add of the direct methods, measured
+    static const double FFT_COST = 5.0;
+
+    // Length of the FFT along one axis, every tile covers length - kernel + 1 pixels of the result
+    static size_t fourierLength(int kernel, int image) {
+      auto limit = FFT::getFastSize((size_t) (image + kernel - 1));
+      limit = min(limit, max(FFT::getFastSize((size_t) kernel * 2), MAX_FFT_LENGTH));
+      size_t best = 0;
+      double bestCost = 0;
+      for (auto length = FFT::getFastSize((size_t) kernel); length <= limit; length = FFT::getFastSize(length + 1)) {
+        auto step = length - kernel + 1;
+        auto tiles = (image + step - 1) / step;
+        double cost = (double) tiles * length * (log2((double) length) + FFT_OVERHEAD);
+        if (best == 0 || cost < bestCost) {
+          best = length;
+          bestCost = cost;
+        }
+      }
+      return best;
+    }
+
+    // Estimated cost of the FFT method per pixel, comparable to the number of taps of the direct methods
+    static double fourierCost(const Kernel &kernel, int width, int height) {
+      auto fftWidth = fourierLength(kernel.width, width), fftHeight = fourierLength(kernel.height, height);
+      auto tilesX = (width + fftWidth - kernel.width) / (fftWidth - kernel.width + 1);
+      auto tilesY = (height + fftHeight - kernel.height) / (fftHeight - kernel.height + 1);
+      // Two forward and two inverse transforms of a tile, spectra are multiplied once per value
+      double transforms = 4.0 * (log2((double) fftWidth) + log2((double) fftHeight)) + 2.0;
+      return FFT_COST * transforms * (double) (tilesX * tilesY * fftWidth * fftHeight) / ((double) width * height);
+    }
+
+    // Swap rows and columns of a block
+    static void transpose(const FFT::Complex *source, FFT::Complex *target, size_t width, size_t height) {
+      const size_t BLOCK = 16;
+      for (size_t y0 = 0; y0 < height; y0 += BLOCK)
+        for (size_t x0 = 0; x0 < width; x0 += BLOCK)
+          for (size_t y = y0; y < min(y0 + BLOCK, height); ++y)
+            for (size_t x = x0; x < min(x0 + BLOCK, width); ++x)
+              target[y + x * height] = source[x + y * width];
+    }
+
+    // Columns are transformed as interleaved sequences, the block is transposed so rows become columns too.
+    // The spectrum stays transposed, inverse transforms start from it and return the block in its original layout
+    static void transform(FFT::Complex *block, FFT::Complex *spectrum, const FFT &rowPlan, const FFT &columnPlan,
+                          bool inverse, FFT::Complex *scratch) {
+      auto width = rowPlan.size, height = columnPlan.size;
+      if (inverse) {
+        rowPlan.inverse(spectrum, scratch, height);
+        transpose(spectrum, block, height, width);
+        columnPlan.inverse(block, scratch, width);
+      } else {
+        columnPlan.forward(block, scratch, width);
+        transpose(block, spectrum, width, height);
+        rowPlan.forward(spectrum, scratch, height);
+      }
+    }
+
+    const FFT &Convolution::getPlan(size_t size) {
+      auto plan = plans.find(size);
+      if (plan == plans.end()) plan = plans.emplace(size, FFT{size}).first;
+      return plan->second;
+    }
+
+    void Convolution::fourier(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border) {
+      int left = kernel.width / 2, top = kernel.height / 2;
+      auto fftWidth = fourierLength(kernel.width, source.width);
+      auto fftHeight = fourierLength(kernel.height, source.height);
+      auto &rowPlan = getPlan(fftWidth);
+      auto &columnPlan = getPlan(fftHeight);
+      auto tileWidth = (int) fftWidth - kernel.width + 1, tileHeight = (int) fftHeight - kernel.height + 1;
+      auto size = fftWidth * fftHeight;
+
+      // Flipped kernel turns the circular convolution into the same sum of taps as the direct method
+      vector<FFT::Complex> weights(size), spectrum(size), scratch(size);
+      for (int y = 0; y < kernel.height; ++y)
+        for (int x = 0; x < kernel.width; ++x)
+          weights[(kernel.width - 1 - x) + (kernel.height - 1 - y) * fftWidth] = kernel.get(x, y) / kernel.factor;
+      transform(weights.data(), spectrum.data(), rowPlan, columnPlan, false, scratch.data());
+
+      int tilesX = (source.width + tileWidth - 1) / tileWidth, tilesY = (source.height + tileHeight - 1) / tileHeight;
+      pool.run((size_t) (tilesX * tilesY), [&](size_t tile, unsigned int) {
+        int x0 = (int) tile % tilesX * tileWidth, y0 = (int) tile / tilesX * tileHeight;
+
+        // Red and green share one complex transform, the kernel is real so they do not mix
+        vector<FFT::Complex> redGreen(size), blue(size), redGreenSpectrum(size), blueSpectrum(size), scratch(size);
+        for (size_t by = 0; by < fftHeight; ++by) {
+          int sy = borderIndex(y0 + (int) by - top, source.height, border);
+          for (size_t bx = 0; bx < fftWidth; ++bx) {
+            int sx = borderIndex(x0 + (int) bx - left, source.width, border);
+            if (sx < 0 || sy < 0) continue;
+            auto &pixel = source.getPixel(sx, sy);
+            redGreen[bx + by * fftWidth] = {pixel.r, pixel.g};
+            blue[bx + by * fftWidth] = {pixel.b, 0.0f};
+          }
+        }
+
+        transform(redGreen.data(), redGreenSpectrum.data(), rowPlan, columnPlan, false, scratch.data());
+        transform(blue.data(), blueSpectrum.data(), rowPlan, columnPlan, false, scratch.data());
+        for (size_t i = 0; i < size; ++i) {
+          redGreenSpectrum[i] = FFT::multiply(redGreenSpectrum[i], spectrum[i]);
+          blueSpectrum[i] = FFT::multiply(blueSpectrum[i], spectrum[i]);
+        }
+        transform(redGreen.data(), redGreenSpectrum.data(), rowPlan, columnPlan, true, scratch.data());
+        transform(blue.data(), blueSpectrum.data(), rowPlan, columnPlan, true, scratch.data());
+
+        // Values wrapped around the tile edge are in the first kernel - 1 rows and columns and are dropped
+        int width = min(tileWidth, source.width - x0), height = min(tileHeight, source.height - y0);
+        for (int y = 0; y < height; ++y) {
+          for (int x = 0; x < width; ++x) {
+            auto i = (size_t) (x + kernel.width - 1) + (size_t) (y + kernel.height - 1) * fftWidth;
+            glm::vec3 color{redGreen[i].real(), redGreen[i].imag(), blue[i].real()};
+            target.getPixel(x0 + x, y0 + y) = color + kernel.bias;
+          }
+        }
+      });
+    }
+
+    // Float images are read around each pixel while the result is written, so they can not be filtered in place
+    static void checkTarget(const FloatImage &source, const FloatImage &target) {
+      if (source.width != target.width || source.height != target.height || &source == &target) {
+        stringstream msg;
+        msg << "Convolution target " << target.width << "x" << target.height << " has to be a different image of "
+            << "the same size as the source " << source.width << "x" << source.height;
+        throw runtime_error(msg.str());
+      }
+    }
+
+    static void checkTarget(const Image &source, const Image &target) {
+      if (source.width != target.width || source.height != target.height) {
+        stringstream msg;
+        msg << "Convolution target " << target.width << "x" << target.height << " does not match the source "
+            << source.width << "x" << source.height;
+        throw runtime_error(msg.str());
+      }
+    }
+
+    void Convolution::convolve(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border,
+                               Method method) {
+      checkTarget(source, target);
+      if (method == Method::Separable && !kernel.isSeparable())
+        throw runtime_error("Convolution kernel is not separable");
+
+      if (method == Method::Automatic) {
+        // Separable passes only pay off when the kernel is larger than one pixel in both directions
+        bool split = kernel.isSeparable() && kernel.width > 1 && kernel.height > 1;
+        double taps = split ? kernel.width + kernel.height : kernel.width * kernel.height;
+        if (fourierCost(kernel, source.width, source.height) < taps) {
+          method = Method::FFT;
+        } else {
+          method = split ? Method::Separable : Method::Direct;
+        }
+      }
+
+      if (method == Method::FFT) {
+        fourier(source, target, kernel, border);
+      } else if (method == Method::Separable && kernel.width > 1 && kernel.height > 1) {
+        separable(source, target, kernel, border);
+      } else {
+        direct(source, target, kernel, border);
+      }
+    }
+
+    void Convolution::apply(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border,
+                            Method method) {
+      arena.reset();
+      convolve(source, target, kernel, border, method);
+    }
+
+    // Running sum over a padded row, the oldest sample leaves the window as a new one enters
+    static void slideRow(float *target, const float *padded, int radius, int width) {
+      double scale = 1.0 / (radius * 2 + 1);
+      double r = 0, g = 0, b = 0;
+      for (int k = 0; k <= radius * 2; ++k) {
+        r += padded[k * 3];
+        g += padded[k * 3 + 1];
+        b += padded[k * 3 + 2];
+      }
+
+      auto leading = padded + (radius * 2 + 1) * 3;
+      for (int x = 0; x < width; ++x) {
+        target[x * 3] = (float) (r * scale);
+        target[x * 3 + 1] = (float) (g * scale);
+        target[x * 3 + 2] = (float) (b * scale);
+        r += leading[x * 3] - padded[x * 3];
+        g += leading[x * 3 + 1] - padded[x * 3 + 1];
+        b += leading[x * 3 + 2] - padded[x * 3 + 2];
+      }
+    }
+
+    void Convolution::boxPasses(const FloatImage &source, FloatImage &target, const vector<int> &radii,
+                                Border border) {
+      auto width = source.width, height = source.height;
+      auto count = (size_t) width * 3;
+      if (radii.empty()) {
+        target.getFramebuffer() = source.getFramebuffer();
+        return;
+      }
+
+      // All horizontal passes of a row run while the row is in cache
+      auto &rowPass = arena.allocate(width, height);
+      int tasks = (height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+      pool.run((size_t) tasks, [&](size_t task, unsigned int thread) {
+        vector<float> line(count);
+        int last = min((int) task * ROWS_PER_TASK + ROWS_PER_TASK, height);
+        for (int y = (int) task * ROWS_PER_TASK; y < last; ++y) {
+          auto input = &source.getPixel(0, y);
+          for (size_t pass = 0; pass < radii.size(); ++pass) {
+            auto output = pass + 1 == radii.size() ? getRow(rowPass, y) : line.data();
+            // One extra sample on the right lets the window slide past the last pixel
+            auto padded = padRow(input, width, radii[pass], radii[pass] + 1, border, thread);
+            slideRow(output, padded, radii[pass], width);
+            input = (const glm::vec3 *) output;
+          }
+        }
+      });
+
+      // Vertical passes keep a running sum of whole rows, columns are split into strips between the threads
+      const size_t STRIP = 256 * 3;
+      auto strips = (count + STRIP - 1) / STRIP;
+      FloatImage *swap = radii.size() > 1 ? &arena.allocate(width, height) : nullptr;
+      const FloatImage *input = &rowPass;
+      for (size_t pass = 0; pass < radii.size(); ++pass) {
+        auto output = pass + 1 == radii.size() ? &target : (input == &rowPass ? swap : &rowPass);
+        int radius = radii[pass];
+        float scale = 1.0f / (float) (radius * 2 + 1);
+        pool.run(strips, [&](size_t strip, unsigned int) {
+          auto first = strip * STRIP, length = min(STRIP, count - first);
+          vector<float> sum(length, 0.0f);
+          const float *taps[3] = {sum.data()};
+          float weights[3] = {1.0f, 1.0f, 1.0f};
+
+          for (int ky = -radius; ky <= radius; ++ky) {
+            int sy = borderIndex(ky, height, border);
+            if (sy < 0) continue;
+            taps[1] = getRow(*input, sy) + first;
+            convolveColumn(sum.data(), taps, weights, 2, length);
+          }
+
+          for (int y = 0; y < height; ++y) {
+            convolveColumn(getRow(*output, y) + first, taps, &scale, 1, length);
+
+            int entering = borderIndex(y + radius + 1, height, border);
+            int leaving = borderIndex(y - radius, height, border);
+            int rowCount = 1;
+            if (entering >= 0) {
+              taps[rowCount] = getRow(*input, entering) + first;
+              weights[rowCount++] = 1.0f;
+            }
+            if (leaving >= 0) {
+              taps[rowCount] = getRow(*input, leaving) + first;
+              weights[rowCount++] = -1.0f;
+            }
+            if (rowCount > 1) convolveColumn(sum.data(), taps, weights, rowCount, length);
+          }
+        });
+        input = output;
+      }
+    }
+
+    void Convolution::boxBlur(const FloatImage &source, FloatImage &target, int radius, Border border) {
+      checkTarget(source, target);
+      arena.reset();
+      boxPasses(source, target, {max(radius, 0)}, border);
+    }
+
+    void Convolution::boxBlur(Image &source, Image &target, int radius, Border border) {
+      checkTarget(source, target);
+      arena.reset();
+      auto &input = toFloat(source);
+      auto &output = arena.allocate(source.width, source.height);
+      boxPasses(input, output, {max(radius, 0)}, border);
+      toImage(output, target);
+    }
+
+    void Convolution::gaussianBlur(const FloatImage &source, FloatImage &target, float sigma, Border border,
+                                   int passes) {
+      checkTarget(source, target);
+      arena.reset();
+      boxPasses(source, target, gaussianBoxes(sigma, passes), border);
+    }
+
+    void Convolution::gaussianBlur(Image &source, Image &target, float sigma, Border border, int passes) {
+      checkTarget(source, target);
+      arena.reset();
+      auto &input = toFloat(source);
+      auto &output = arena.allocate(source.width, source.height);
+      boxPasses(input, output, gaussianBoxes(sigma, passes), border);
+      toImage(output, target);
+    }
+
+    FloatImage &Convolution::toFloat(Image &source) {
+      // Float copies come from the arena so repeated filtering does not allocate
+      auto &result = arena.allocate(source.width, source.height);
+      auto pixels = &source.getFramebuffer().data()->r;
+      auto values = (float *) result.getFramebuffer().data();
+      auto count = (size_t) source.width * source.height * 3;
+      for (size_t i = 0; i < count; ++i)
+        values[i] = pixels[i] / 255.0f;
+      return result;
+    }
+
+    void Convolution::toImage(const FloatImage &source, Image &target) {
+      auto values = (const float *) source.getFramebuffer().data();
+      auto pixels = &target.getFramebuffer().data()->r;
+      auto count = (size_t) source.width * source.height * 3;
+      for (size_t i = 0; i < count; ++i)
+        pixels[i] = (uint8_t) (min(max(values[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    void Convolution::apply(Image &source, Image &target, const Kernel &kernel, Border border, Method method) {
+      checkTarget(source, target);
+      arena.reset();
+      auto &input = toFloat(source);
+      auto &output = arena.allocate(source.width, source.height);
+      convolve(input, output, kernel, border, method);
+      toImage(output, target);
+    }
+  }
+}
@@ -0,0 +1,285 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "image.h"
+#include "image_hdr.h"
+#include "image_pool.h"
+#include "thread_pool.h"
+#include "fft.h"
+
+namespace ppgso {
+  namespace convolution {
+
+    /*!
+     * Handling of samples outside of the image
+     */
+    enum class Border {
+      Clamp,   // Edge pixels are repeated
+      Mirror,  // Image is reflected around the edge pixels
+      Wrap,    // Image repeats from the opposite edge
+      Zero     // Samples outside of the image are black
+    };
+
+    /*!
+     * Algorithm used to compute the convolution
+     */
+    enum class Method {
+      Automatic,  // Cheapest of the methods below for the kernel and image size
+      Direct,     // All taps of the 2D kernel for every pixel
+      Separable,  // Horizontal and vertical 1D pass, only for separable kernels
+      FFT         // Product of spectra of image tiles and the kernel, cost does not grow with the kernel size
+    };
+
+    /*!
+     * 2D convolution kernel of any size, the result is the weighted sum of samples divided by factor plus bias.
+     * The center of the kernel is at (width / 2, height / 2). Kernels that are an outer product of a horizontal
+     * and a vertical 1D kernel are detected and can be applied as two 1D passes.
+     */
+    class Kernel {
+    public:
+      /*!
+       * Create kernel from weights.
+       *
+       * @param width - Width of the kernel.
+       * @param height - Height of the kernel.
+       * @param weights - Weights stored row by row, width * height values.
+       * @param factor - Weighted sum is divided by the factor.
+       * @param bias - Value added to the result, colors are in the <0, 1> range.
+       */
+      Kernel(int width, int height, const std::vector<float> &weights, float factor = 1.0f, float bias = 0.0f);
+
+      /*!
+       * Create kernel as an outer product of two 1D kernels.
+       *
+       * @param horizontal - Weights along x.
+       * @param vertical - Weights along y.
+       * @param factor - Weighted sum is divided by the factor.
+       * @param bias - Value added to the result.
+       * @return - Separable kernel.
+       */
+      static Kernel separable(const std::vector<float> &horizontal, const std::vector<float> &vertical,
+                              float factor = 1.0f, float bias = 0.0f);
+
+      /*!
+       * Create normalized Gaussian blur kernel reaching 3 sigma from the center.
+       *
+       * @param sigma - Standard deviation in pixels.
+       * @return - Separable Gaussian kernel.
+       */
+      static Kernel gaussian(float sigma);
+
+      /*!
+       * Create normalized box blur kernel.
+       *
+       * @param radius - Number of pixels on each side of the center.
+       * @return - Separable box kernel.
+       */
+      static Kernel box(int radius);
+
+      /*!
+       * Get weight of a single tap.
+       *
+       * @param x - Horizontal position in the kernel.
+       * @param y - Vertical position in the kernel.
+       * @return - Weight of the tap.
+       */
+      float get(int x, int y) const;
+
+      /*!
+       * Check whether the kernel can be applied as two 1D passes.
+       *
+       * @return - True if the kernel is separable.
+       */
+      bool isSeparable() const;
+
+      /*!
+       * Get the horizontal factor of a separable kernel.
+       *
+       * @return - Weights along x, empty if the kernel is not separable.
+       */
+      const std::vector<float> &getHorizontal() const;
+
+      /*!
+       * Get the vertical factor of a separable kernel.
+       *
+       * @return - Weights along y, empty if the kernel is not separable.
+       */
+      const std::vector<float> &getVertical() const;
+
+      int width, height;
+      float factor, bias;
+    private:
+      std::vector<float> weights, horizontal, vertical;
+    };
+
+    /*!
+     * Radii of box blurs that approximate a Gaussian blur when applied one after another.
+     *
+     * @param sigma - Standard deviation of the Gaussian in pixels.
+     * @param passes - Number of box blurs, 3 passes are within a few percent of the Gaussian.
+     * @return - Radius of each pass.
+     */
+    std::vector<int> gaussianBoxes(float sigma, int passes = 3);
+
+    /*!
+     * Sums of all pixels above and to the left of each position. The sum of any rectangle takes four lookups,
+     * so box filters cost the same for every radius and the radius may change from pixel to pixel.
+     */
+    class SummedAreaTable {
+    public:
+      /*!
+       * Build the table from an 8 bit image.
+       *
+       * @param image - Image to sum.
+       */
+      explicit SummedAreaTable(Image &image);
+
+      /*!
+       * Sum the part of a rectangle that lies inside of the image.
+       *
+       * @param x - Horizontal position of the top left corner.
+       * @param y - Vertical position of the top left corner.
+       * @param width - Width of the rectangle.
+       * @param height - Height of the rectangle.
+       * @return - Sum of the 8 bit channels.
+       */
+      glm::dvec3 getSum(int x, int y, int width, int height) const;
+
+      /*!
+       * Average color of the part of a rectangle that lies inside of the image.
+       *
+       * @param x - Horizontal position of the top left corner.
+       * @param y - Vertical position of the top left corner.
+       * @param width - Width of the rectangle.
+       * @param height - Height of the rectangle.
+       * @return - Color in the <0, 1> range, black if the rectangle misses the image.
+       */
+      glm::vec3 getAverage(int x, int y, int width, int height) const;
+
+      /*!
+       * Box blur of the summed image, windows are cut at the image border and averaged over the remaining pixels.
+       *
+       * @param target - Image of the same size to store the result to.
+       * @param radius - Number of pixels on each side of the center.
+       */
+      void blur(Image &target, int radius) const;
+
+      int width, height;
+    private:
+      std::vector<uint64_t> sums;
+    };
+
+    /*!
+     * Applies convolution kernels to images. Rows are split between threads of a pool and each row is computed
+     * with vectorized multiply-adds over all three channels at once. Samples outside of the image come from
+     * padded copies of the source rows, so the inner loops never check the borders.
+     *
+     * Large kernels are applied in the frequency domain. The image is split into tiles that overlap by the kernel
+     * size (overlap-save), each tile is transformed, multiplied by the spectrum of the kernel and transformed back.
+     * Tiles are independent so they run in parallel, and FFT plans are kept for the next image of the same size.
+     */
+    class Convolution {
+    public:
+      /*!
+       * Create convolution with its own thread pool.
+       *
+       * @param threads - Number of threads, 0 uses all hardware threads.
+       */
+      explicit Convolution(unsigned int threads = 0);
+
+      /*!
+       * Convolve a floating point image.
+       *
+       * @param source - Image to convolve.
+       * @param target - Image of the same size to store the result to, must not be the source.
+       * @param kernel - Kernel to apply.
+       * @param border - Handling of samples outside of the image.
+       * @param method - Algorithm to use.
+       */
+      void apply(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border = Border::Clamp,
+                 Method method = Method::Automatic);
+
+      /*!
+       * Convolve an 8 bit image, colors are converted to the <0, 1> range and clamped after the convolution.
+       *
+       * @param source - Image to convolve.
+       * @param target - Image of the same size to store the result to, may be the source.
+       * @param kernel - Kernel to apply.
+       * @param border - Handling of samples outside of the image.
+       * @param method - Algorithm to use.
+       */
+      void apply(Image &source, Image &target, const Kernel &kernel, Border border = Border::Clamp,
+                 Method method = Method::Automatic);
+
+      /*!
+       * Box blur a floating point image using running sums, the cost per pixel does not depend on the radius.
+       *
+       * @param source - Image to blur.
+       * @param target - Image of the same size to store the result to, must not be the source.
+       * @param radius - Number of pixels on each side of the center.
+       * @param border - Handling of samples outside of the image.
+       */
+      void boxBlur(const FloatImage &source, FloatImage &target, int radius, Border border = Border::Clamp);
+
+      /*!
+       * Box blur an 8 bit image using running sums, the cost per pixel does not depend on the radius.
+       *
+       * @param source - Image to blur.
+       * @param target - Image of the same size to store the result to, may be the source.
+       * @param radius - Number of pixels on each side of the center.
+       * @param border - Handling of samples outside of the image.
+       */
+      void boxBlur(Image &source, Image &target, int radius, Border border = Border::Clamp);
+
+      /*!
+       * Approximate Gaussian blur of a floating point image by repeated box blurs, see gaussianBoxes.
+       * The border is applied in every pass.
+       *
+       * @param source - Image to blur.
+       * @param target - Image of the same size to store the result to, must not be the source.
+       * @param sigma - Standard deviation in pixels.
+       * @param border - Handling of samples outside of the image.
+       * @param passes - Number of box blurs.
+       */
+      void gaussianBlur(const FloatImage &source, FloatImage &target, float sigma, Border border = Border::Clamp,
+                        int passes = 3);
+
+      /*!
+       * Approximate Gaussian blur of an 8 bit image by repeated box blurs, see gaussianBoxes.
+       *
+       * @param source - Image to blur.
+       * @param target - Image of the same size to store the result to, may be the source.
+       * @param sigma - Standard deviation in pixels.
+       * @param border - Handling of samples outside of the image.
+       * @param passes - Number of box blurs.
+       */
+      void gaussianBlur(Image &source, Image &target, float sigma, Border border = Border::Clamp, int passes = 3);
+
+      /*!
+       * Get the number of threads used.
+       *
+       * @return - Number of threads.
+       */
+      unsigned int getThreadCount() const;
+
+    private:
+      ThreadPool pool;
+      FloatImageArena arena;
+      std::vector<std::vector<float>> rows;
+      std::map<size_t, FFT> plans;
+
+      void convolve(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border, Method method);
+      void direct(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border);
+      void separable(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border);
+      void fourier(const FloatImage &source, FloatImage &target, const Kernel &kernel, Border border);
+      const FFT &getPlan(size_t size);
+      const float *padRow(const glm::vec3 *row, int width, int left, int right, Border border, unsigned int thread);
+      static void padRow(const glm::vec3 *row, int width, int left, int right, Border border, float *target);
+      void boxPasses(const FloatImage &source, FloatImage &target, const std::vector<int> &radii, Border border);
+      FloatImage &toFloat(Image &source);
+      void toImage(const FloatImage &source, Image &target);
+    };
+  }
+}
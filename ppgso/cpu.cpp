@@ -0,0 +1,76 @@
+#include "cpu.h"
+
+#if defined(PPGSO_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace ppgso {
+  namespace cpu {
+
+#if defined(PPGSO_X86) && (defined(__GNUC__) || defined(__clang__))
+
+    bool hasSSE2() {
+      return __builtin_cpu_supports("sse2") != 0;
+    }
+
+    bool hasSSSE3() {
+      return __builtin_cpu_supports("ssse3") != 0;
+    }
+
+    bool hasAVX2() {
+      return __builtin_cpu_supports("avx2") != 0;
+    }
+
+#elif defined(PPGSO_X86) && defined(_MSC_VER)
+
+    // Read CPUID registers for a given leaf
+    static void cpuid(int info[4], int leaf) {
+      __cpuidex(info, leaf, 0);
+    }
+
+    bool hasSSE2() {
+      int info[4];
+      cpuid(info, 1);
+      return (info[3] & (1 << 26)) != 0;
+    }
+
+    bool hasSSSE3() {
+      int info[4];
+      cpuid(info, 1);
+      return (info[2] & (1 << 9)) != 0;
+    }
+
+    bool hasAVX2() {
+      int info[4];
+      cpuid(info, 0);
+      if (info[0] < 7) return false;
+
+      // The operating system has to preserve the YMM registers
+      cpuid(info, 1);
+      bool osxsave = (info[2] & (1 << 27)) != 0;
+      bool avx = (info[2] & (1 << 28)) != 0;
+      if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+      cpuid(info, 7);
+      return (info[1] & (1 << 5)) != 0;
+    }
+
+#else
+
+    bool hasSSE2() {
+      return false;
+    }
+
+    bool hasSSSE3() {
+      return false;
+    }
+
+    bool hasAVX2() {
+      return false;
+    }
+
+#endif
+
+  }
+}
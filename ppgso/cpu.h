@@ -0,0 +1,39 @@
+#pragma once
+
+// Architecture detection for optional SIMD code paths
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PPGSO_X86 1
+#endif
+
+// Allows compiling single functions for an instruction set that is not enabled for the whole build,
+// such functions must only be called after the matching runtime check below
+#if defined(__GNUC__) || defined(__clang__)
+#define PPGSO_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PPGSO_TARGET(isa)
+#endif
+
+namespace ppgso {
+  namespace cpu {
+    /*!
+     * Check whether the CPU supports SSE2 instructions.
+     *
+     * @return - True if SSE2 can be used.
+     */
+    bool hasSSE2();
+
+    /*!
+     * Check whether the CPU supports SSSE3 instructions.
+     *
+     * @return - True if SSSE3 can be used.
+     */
+    bool hasSSSE3();
+
+    /*!
+     * Check whether the CPU and operating system support AVX2 instructions.
+     *
+     * @return - True if AVX2 can be used.
+     */
+    bool hasAVX2();
+  }
+}
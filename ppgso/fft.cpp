@@ -0,0 +1,170 @@
+#include <cmath>
+#include <algorithm>
+
+#include <glm/gtc/constants.hpp>
+
+#include "fft.h"
+
+using namespace std;
+using namespace ppgso;
+
+static FFT::Complex root(size_t numerator, size_t denominator) {
+  double angle = -2.0 * glm::pi<double>() * (double) numerator / (double) denominator;
+  return {(float) cos(angle), (float) sin(angle)};
+}
+
+FFT::FFT(size_t size) : size{size} {
+  // Radix 4 stages first, they need the fewest multiplications per value
+  vector<size_t> radices;
+  size_t remaining = size;
+  while (remaining % 4 == 0) {
+    radices.push_back(4);
+    remaining /= 4;
+  }
+  for (size_t factor = 2; remaining > 1; ++factor) {
+    while (remaining % factor == 0) {
+      radices.push_back(factor);
+      remaining /= factor;
+    }
+  }
+
+  size_t length = size;
+  for (auto radix : radices) {
+    Stage stage;
+    stage.radix = radix;
+    stage.span = length / radix;
+    stage.twiddles.resize(length);
+    for (size_t p = 0; p < stage.span; ++p)
+      for (size_t k = 0; k < radix; ++k)
+        stage.twiddles[p * radix + k] = root(p * k, length);
+    for (size_t k = 0; k < radix; ++k)
+      stage.roots.push_back(root(k, radix));
+    stages.push_back(move(stage));
+    largestRadix = max(largestRadix, radix);
+    length /= radix;
+  }
+}
+
+// Butterflies of one stage, value q of butterfly p reads x[q + stride * (p + j * span)] for j below the radix
+// and writes the radix results to y[q + stride * (p * radix + k)] multiplied by the twiddle factors
+static void radix2(const FFT::Complex *__restrict x, FFT::Complex *__restrict y, size_t stride, size_t span,
+                   const FFT::Complex *twiddles) {
+  for (size_t p = 0; p < span; ++p) {
+    auto w = twiddles + p * 2;
+    auto input = x + stride * p;
+    auto output = y + stride * p * 2;
+    for (size_t q = 0; q < stride; ++q) {
+      auto a = input[q], b = input[q + stride * span];
+      output[q] = a + b;
+      output[q + stride] = FFT::multiply(a - b, w[1]);
+    }
+  }
+}
+
+static void radix3(const FFT::Complex *__restrict x, FFT::Complex *__restrict y, size_t stride, size_t span,
+                   const FFT::Complex *twiddles) {
+  // sin(2 pi / 3) rotates the difference of the odd terms
+  const float sine = 0.866025403784f;
+  for (size_t p = 0; p < span; ++p) {
+    auto w = twiddles + p * 3;
+    auto input = x + stride * p;
+    auto output = y + stride * p * 3;
+    for (size_t q = 0; q < stride; ++q) {
+      auto a = input[q], b = input[q + stride * span], c = input[q + stride * span * 2];
+      auto sum = b + c, difference = b - c;
+      auto middle = a - sum * 0.5f;
+      FFT::Complex rotated{difference.imag() * sine, -difference.real() * sine};
+      output[q] = a + sum;
+      output[q + stride] = FFT::multiply(middle + rotated, w[1]);
+      output[q + stride * 2] = FFT::multiply(middle - rotated, w[2]);
+    }
+  }
+}
+
+static void radix4(const FFT::Complex *__restrict x, FFT::Complex *__restrict y, size_t stride, size_t span,
+                   const FFT::Complex *twiddles) {
+  for (size_t p = 0; p < span; ++p) {
+    auto w = twiddles + p * 4;
+    auto input = x + stride * p;
+    auto output = y + stride * p * 4;
+    for (size_t q = 0; q < stride; ++q) {
+      auto a = input[q], b = input[q + stride * span];
+      auto c = input[q + stride * span * 2], d = input[q + stride * span * 3];
+      auto t0 = a + c, t1 = a - c, t2 = b + d, t3 = b - d;
+      // Multiplication by -i
+      t3 = {t3.imag(), -t3.real()};
+      output[q] = t0 + t2;
+      output[q + stride] = FFT::multiply(t1 + t3, w[1]);
+      output[q + stride * 2] = FFT::multiply(t0 - t2, w[2]);
+      output[q + stride * 3] = FFT::multiply(t1 - t3, w[3]);
+    }
+  }
+}
+
+// Any other radix is a small DFT
+static void radixN(const FFT::Complex *x, FFT::Complex *y, size_t stride, size_t span, size_t radix,
+                   const FFT::Complex *twiddles, const FFT::Complex *roots, FFT::Complex *values) {
+  for (size_t p = 0; p < span; ++p) {
+    auto w = twiddles + p * radix;
+    for (size_t q = 0; q < stride; ++q) {
+      auto input = x + q + stride * p;
+      auto output = y + q + stride * radix * p;
+      for (size_t j = 0; j < radix; ++j)
+        values[j] = input[stride * span * j];
+      for (size_t k = 0; k < radix; ++k) {
+        auto sum = values[0];
+        for (size_t j = 1, index = k; j < radix; ++j, index = index + k < radix ? index + k : index + k - radix)
+          sum += FFT::multiply(values[j], roots[index]);
+        output[stride * k] = FFT::multiply(sum, w[k]);
+      }
+    }
+  }
+}
+
+void FFT::transform(Complex *data, Complex *scratch, size_t count) const {
+  // Stockham autosort, every stage reads one buffer and writes the other so no bit reversal is needed.
+  // Interleaved sequences are the same as a stage with a longer stride, their values are next to each other
+  Complex *x = data, *y = scratch;
+  vector<Complex> values(largestRadix);
+  size_t stride = count;
+  for (auto &stage : stages) {
+    auto twiddles = stage.twiddles.data();
+    switch (stage.radix) {
+      case 2:
+        radix2(x, y, stride, stage.span, twiddles);
+        break;
+      case 3:
+        radix3(x, y, stride, stage.span, twiddles);
+        break;
+      case 4:
+        radix4(x, y, stride, stage.span, twiddles);
+        break;
+      default:
+        radixN(x, y, stride, stage.span, stage.radix, twiddles, stage.roots.data(), values.data());
+    }
+    swap(x, y);
+    stride *= stage.radix;
+  }
+  if (x != data) copy(x, x + size * count, data);
+}
+
+void FFT::forward(Complex *data, Complex *scratch, size_t count) const {
+  transform(data, scratch, count);
+}
+
+void FFT::inverse(Complex *data, Complex *scratch, size_t count) const {
+  // Inverse transform is the forward transform of the conjugated spectrum
+  for (size_t i = 0; i < size * count; ++i)
+    data[i] = conj(data[i]);
+  transform(data, scratch, count);
+  float scale = 1.0f / (float) size;
+  for (size_t i = 0; i < size * count; ++i)
+    data[i] = {data[i].real() * scale, -data[i].imag() * scale};
+}
+
+size_t FFT::getFastSize(size_t minimum) {
+  size_t power = 1, triple = 3;
+  while (power < minimum) power *= 2;
+  while (triple < minimum) triple *= 2;
+  return min(power, triple);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <complex>
+
+namespace ppgso {
+
+  /*!
+   * Fast Fourier transform of complex sequences of one fixed length.
+   *
+   * The length is split into radix 4, 2 and 3 stages, remaining prime factors use a generic butterfly so any
+   * length works. Twiddle factors of all stages are computed once when the transform is created, so a single
+   * instance should be kept for repeated transforms of the same length. Transforms are const and can run on many
+   * threads at once, each with its own scratch buffer. Several interleaved sequences are transformed in one pass,
+   * the innermost loop then runs over neighbouring values.
+   */
+  class FFT {
+  public:
+    using Complex = std::complex<float>;
+
+    /*!
+     * Prepare transform of the given length.
+     *
+     * @param size - Number of complex values in a sequence.
+     */
+    explicit FFT(size_t size);
+
+    /*!
+     * Transform interleaved sequences to the frequency domain in place, value i of sequence j is at
+     * data[i * count + j]. Columns of an image with count pixels per row are transformed in one call this way.
+     *
+     * @param data - Sequences of size values each.
+     * @param scratch - Buffer of size * count values used by the stages.
+     * @param count - Number of interleaved sequences.
+     */
+    void forward(Complex *data, Complex *scratch, size_t count = 1) const;
+
+    /*!
+     * Transform interleaved sequences back from the frequency domain in place, the result is divided by the size.
+     *
+     * @param data - Spectra of size values each.
+     * @param scratch - Buffer of size * count values used by the stages.
+     * @param count - Number of interleaved sequences.
+     */
+    void inverse(Complex *data, Complex *scratch, size_t count = 1) const;
+
+    /*!
+     * Smallest power of two or three times a power of two, such lengths only use the fastest stages.
+     *
+     * @param minimum - Required length.
+     * @return - Fast length that is at least the minimum.
+     */
+    static size_t getFastSize(size_t minimum);
+
+    /*!
+     * Multiply complex values. Written out, std::complex multiplication checks for infinities and is several
+     * times slower.
+     *
+     * @param a - First value.
+     * @param b - Second value.
+     * @return - Product of the values.
+     */
+    static Complex multiply(const Complex &a, const Complex &b) {
+      return {a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real()};
+    }
+
+    size_t size;
+  private:
+    struct Stage {
+      size_t radix, span;
+      std::vector<Complex> twiddles;
+      std::vector<Complex> roots;
+    };
+    std::vector<Stage> stages;
+    size_t largestRadix = 1;
+
+    void transform(Complex *data, Complex *scratch, size_t count) const;
+  };
+}
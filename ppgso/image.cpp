@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "image.h"
+#include "pixel_convert.h"
 
 using namespace std;
 using namespace ppgso;
@@ -20,7 +23,19 @@ void Image::setPixel(int x, int y, const Image::Pixel& color) {
 }
 
 void Image::clear(const Image::Pixel &color) {
-  framebuffer = vector<Pixel>(framebuffer.size(), color);
+  pixel::fill((uint8_t *) framebuffer.data(), &color.r, framebuffer.size());
+}
+
+void Image::fillSpan(int x, int y, int length, const Image::Pixel &color) {
+  fillRect(x, y, length, 1, color);
+}
+
+void Image::fillRect(int x, int y, int width, int height, const Image::Pixel &color) {
+  // Clip the rectangle to the image
+  int x0 = max(x, 0), y0 = max(y, 0);
+  int x1 = min(x + width, this->width), y1 = min(y + height, this->height);
+  for (int row = y0; row < y1 && x0 < x1; ++row)
+    pixel::fill((uint8_t *) &framebuffer[x0 + row * this->width], &color.r, (size_t) (x1 - x0));
 }
 
 void Image::setPixel(int x, int y, int r, int g, int b) {
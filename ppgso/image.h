@@ -65,11 +65,30 @@ namespace ppgso {
     void setPixel(int x, int y, float r, float g, float b);
 
     /*!
-     * Clear the image using single color
+     * Clear the image using single color, the framebuffer is filled in place
      * @param color Pixel color to set the image to
      */
     void clear(const Pixel& color = {0,0,0});
 
+    /*!
+     * Fill a horizontal span of pixels, pixels outside of the image are skipped
+     * @param x Horizontal coordinate of the first pixel
+     * @param y Vertical coordinate
+     * @param length Number of pixels to fill
+     * @param color Pixel color to fill the span with
+     */
+    void fillSpan(int x, int y, int length, const Pixel& color);
+
+    /*!
+     * Fill a rectangle, pixels outside of the image are skipped
+     * @param x Horizontal coordinate of the top left corner
+     * @param y Vertical coordinate of the top left corner
+     * @param width Width of the rectangle
+     * @param height Height of the rectangle
+     * @param color Pixel color to fill the rectangle with
+     */
+    void fillRect(int x, int y, int width, int height, const Pixel& color);
+
     int width, height;
   private:
     std::vector<Pixel> framebuffer;
@@ -1,7 +1,12 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <limits>
 #include "image_bmp.h"
+#include "pixel_convert.h"
 
 using namespace std;
 
@@ -35,87 +40,274 @@ namespace ppgso {
     } BITMAPINFOHEADER;
 #pragma pack()
 
-    Image loadBMP(const std::string &bmp) {
-      BITMAPFILEHEADER bmpFileHeader = {};
-      BITMAPINFOHEADER bmpInfoHeader = {};
+    // Compression methods
+    static const unsigned int BI_RGB = 0;
+    static const unsigned int BI_RLE8 = 1;
+    static const unsigned int BI_BITFIELDS = 3;
 
-      ifstream input_file(bmp, ios::binary);
+    static void fail(const char *message, const std::string &bmp) {
+      stringstream msg;
+      msg << message << " " << bmp;
+      throw runtime_error(msg.str());
+    }
 
-      // Check headers
-      if (!input_file.is_open()) {
-        stringstream msg;
-        msg << "Could not open BMP file. " << bmp;
-        throw runtime_error(msg.str());
-      }
+    // Read and validate headers shared by all supported formats
+    static void readHeaders(const MappedFile &file, const std::string &bmp, BITMAPFILEHEADER &bmpFileHeader,
+                            BITMAPINFOHEADER &bmpInfoHeader) {
+      if (file.size() < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+        fail("BMP file does not contain supported BMP format.", bmp);
 
-      input_file.read((char *) &bmpFileHeader, sizeof(BITMAPFILEHEADER));
-      input_file.read((char *) &bmpInfoHeader, sizeof(BITMAPINFOHEADER));
+      memcpy(&bmpFileHeader, file.data(), sizeof(BITMAPFILEHEADER));
+      memcpy(&bmpInfoHeader, file.data() + sizeof(BITMAPFILEHEADER), sizeof(BITMAPINFOHEADER));
 
-      if (bmpFileHeader.bfType != 19778) {
-        stringstream msg;
-        msg << "BMP file does not contain supported BMP format. " << bmp;
-        throw runtime_error(msg.str());
-      }
+      if (bmpFileHeader.bfType != 19778 || bmpInfoHeader.biSize < sizeof(BITMAPINFOHEADER))
+        fail("BMP file does not contain supported BMP format.", bmp);
 
-      if (bmpInfoHeader.biBitCount != 24) {
-        stringstream msg;
-        msg << "BMP file does not contain supported bit count. " << bmp;
-        throw runtime_error(msg.str());
+      if (bmpInfoHeader.biWidth <= 0 || bmpInfoHeader.biHeight == 0)
+        fail("BMP file does not contain any data.", bmp);
+
+      if (bmpFileHeader.bfOffBits > file.size())
+        fail("BMP file is truncated.", bmp);
+    }
+
+    // Rows of uncompressed formats, bottom-up unless the height is negative
+    struct RowLayout {
+      const uint8_t *top;
+      ptrdiff_t stride;
+    };
+
+    static RowLayout getRows(const MappedFile &file, const std::string &bmp, const BITMAPFILEHEADER &bmpFileHeader,
+                             const BITMAPINFOHEADER &bmpInfoHeader) {
+      size_t height = (size_t) abs(bmpInfoHeader.biHeight);
+      auto row_padded = ((size_t) bmpInfoHeader.biWidth * bmpInfoHeader.biBitCount + 31) / 32 * 4;
+      if ((file.size() - bmpFileHeader.bfOffBits) / row_padded < height)
+        fail("BMP file is truncated.", bmp);
+
+      auto data = file.data() + bmpFileHeader.bfOffBits;
+      if (bmpInfoHeader.biHeight < 0) return {data, (ptrdiff_t) row_padded};
+      return {data + (height - 1) * row_padded, -(ptrdiff_t) row_padded};
+    }
+
+    // Palette follows the info header, entries are stored as BGRX
+    static array<Image::Pixel, 256> readPalette(const MappedFile &file, const std::string &bmp,
+                                                const BITMAPINFOHEADER &bmpInfoHeader) {
+      size_t colors = bmpInfoHeader.biClrUsed ? bmpInfoHeader.biClrUsed : 256;
+      size_t offset = sizeof(BITMAPFILEHEADER) + bmpInfoHeader.biSize;
+      if (colors > 256 || file.size() < offset || (file.size() - offset) / 4 < colors)
+        fail("BMP file does not contain a valid palette.", bmp);
+
+      array<Image::Pixel, 256> palette{};
+      auto entry = file.data() + offset;
+      for (size_t i = 0; i < colors; ++i, entry += 4)
+        palette[i] = {entry[2], entry[1], entry[0]};
+      return palette;
+    }
+
+    static void decodePaletted(const MappedFile &file, const std::string &bmp, const BITMAPFILEHEADER &bmpFileHeader,
+                               const BITMAPINFOHEADER &bmpInfoHeader, Image &image) {
+      auto palette = readPalette(file, bmp, bmpInfoHeader);
+      auto rows = getRows(file, bmp, bmpFileHeader, bmpInfoHeader);
+      for (int y = 0; y < image.height; ++y) {
+        auto source = rows.top + y * rows.stride;
+        auto target = &image.getPixel(0, y);
+        for (int x = 0; x < image.width; ++x)
+          target[x] = palette[source[x]];
       }
+    }
 
-      if (bmpInfoHeader.biCompression != 0) { // BI_RGB only
-        stringstream msg;
-        msg << "BMP file does not use expected compression method. " << bmp;
-        throw runtime_error(msg.str());
+    // Runs of palette indices, pixels skipped by the end of line and delta escapes keep the first palette color
+    static void decodeRLE8(const MappedFile &file, const std::string &bmp, const BITMAPFILEHEADER &bmpFileHeader,
+                           const BITMAPINFOHEADER &bmpInfoHeader, Image &image) {
+      if (bmpInfoHeader.biHeight < 0)
+        fail("BMP file uses compression that can not be stored top-down.", bmp);
+
+      auto palette = readPalette(file, bmp, bmpInfoHeader);
+      image.clear(palette[0]);
+
+      auto data = file.data();
+      size_t position = bmpFileHeader.bfOffBits, size = file.size();
+      int x = 0, y = image.height - 1;
+      while (y >= 0) {
+        if (position + 2 > size) fail("BMP file is truncated.", bmp);
+        uint8_t count = data[position++], value = data[position++];
+
+        if (count > 0) {
+          // Encoded run of a single index
+          if (count > image.width - x) fail("BMP file contains a run outside of the image.", bmp);
+          fill_n(&image.getPixel(x, y), count, palette[value]);
+          x += count;
+        } else if (value == 0) {
+          // End of line
+          x = 0;
+          --y;
+        } else if (value == 1) {
+          // End of bitmap
+          break;
+        } else if (value == 2) {
+          // Delta moves the position right and up
+          if (position + 2 > size) fail("BMP file is truncated.", bmp);
+          x += data[position++];
+          y -= data[position++];
+          if (x > image.width) fail("BMP file contains a run outside of the image.", bmp);
+        } else {
+          // Absolute run of indices padded to 16 bits
+          if (value > image.width - x) fail("BMP file contains a run outside of the image.", bmp);
+          if (size - position < value) fail("BMP file is truncated.", bmp);
+          auto target = &image.getPixel(x, y);
+          for (int i = 0; i < value; ++i)
+            target[i] = palette[data[position + i]];
+          x += value;
+          position += (value + 1) & ~1;
+        }
       }
+    }
 
-      int width = (unsigned int) bmpInfoHeader.biWidth;
-      int height = (unsigned int) abs(bmpInfoHeader.biHeight);
-      bool flipped = bmpInfoHeader.biHeight < 0;
+    // Channel stored under a bit mask, expanded to 8 bits
+    struct Channel {
+      uint32_t mask, shift, max;
 
-      if (width == 0 || height == 0) {
-        stringstream msg;
-        msg << "BMP file does not contain any data. " << bmp;
-        throw runtime_error(msg.str());
+      Channel(uint32_t mask) : mask{mask}, shift{0}, max{0} {
+        if (!mask) return;
+        while (!(mask & (1u << shift))) ++shift;
+        max = mask >> shift;
       }
 
-      Image image{width, height};
-      auto &framebuffer = image.getFramebuffer();
+      uint8_t get(uint32_t value) const {
+        if (!max) return 0;
+        return (uint8_t) ((uint64_t) ((value & mask) >> shift) * 255 / max);
+      }
+    };
 
-      // Load data
-      input_file.seekg(bmpFileHeader.bfOffBits, input_file.beg);
+    static void decodeBitfields(const MappedFile &file, const std::string &bmp, const BITMAPFILEHEADER &bmpFileHeader,
+                                const BITMAPINFOHEADER &bmpInfoHeader, Image &image) {
+      auto bits = bmpInfoHeader.biBitCount;
+      uint32_t masks[3];
+      if (bmpInfoHeader.biCompression == BI_BITFIELDS) {
+        // Masks follow the 40 byte info header, V4 and V5 headers store them at the same place
+        size_t offset = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+        if (file.size() < offset + sizeof(masks)) fail("BMP file is truncated.", bmp);
+        memcpy(masks, file.data() + offset, sizeof(masks));
+      } else if (bits == 32) {
+        masks[0] = 0xff0000, masks[1] = 0xff00, masks[2] = 0xff;
+      } else {
+        masks[0] = 0x7c00, masks[1] = 0x3e0, masks[2] = 0x1f;
+      }
 
-      // BMP uses padding for rows
-      unsigned int row_padded = (width * sizeof(Image::Pixel) + 3) & (~3);
+      auto rows = getRows(file, bmp, bmpFileHeader, bmpInfoHeader);
 
-      for (int j = 0; j < height; j++) {
-        auto row_data = vector<Image::Pixel>(row_padded);
-        input_file.read((char *) row_data.data(), row_padded);
-        for (int i = 0; i < width; i++) {
-          auto pixel = row_data[i];
-          swap(pixel.r, pixel.b);
-          if (flipped) {
-            framebuffer[i + j * width] = pixel;
+      // BGRX and BGRA pixels only need to drop the fourth byte
+      if (bits == 32 && masks[0] == 0xff0000 && masks[1] == 0xff00 && masks[2] == 0xff) {
+        for (int y = 0; y < image.height; ++y)
+          pixel::bgraToRGB(rows.top + y * rows.stride, (uint8_t *) &image.getPixel(0, y), (size_t) image.width);
+        return;
+      }
+
+      Channel r{masks[0]}, g{masks[1]}, b{masks[2]};
+      for (int y = 0; y < image.height; ++y) {
+        auto source = rows.top + y * rows.stride;
+        auto target = &image.getPixel(0, y);
+        for (int x = 0; x < image.width; ++x) {
+          uint32_t value;
+          if (bits == 32) {
+            memcpy(&value, source + x * 4, 4);
           } else {
-            framebuffer[i + (height - 1 - j) * width] = pixel;
+            uint16_t value16;
+            memcpy(&value16, source + x * 2, 2);
+            value = value16;
           }
+          target[x] = {r.get(value), g.get(value), b.get(value)};
         }
       }
-      input_file.close();
+    }
 
+    static MappedImage map24(MappedFile file, const BITMAPFILEHEADER &bmpFileHeader,
+                             const BITMAPINFOHEADER &bmpInfoHeader) {
+      int width = bmpInfoHeader.biWidth;
+      int height = abs(bmpInfoHeader.biHeight);
+      bool flipped = bmpInfoHeader.biHeight < 0;
+
+      // BMP uses padding for rows, rows are stored bottom-up unless the height is negative
+      auto row_padded = (ptrdiff_t) ((width * sizeof(Image::Pixel) + 3) & (~3));
+      if (flipped)
+        return {move(file), width, height, bmpFileHeader.bfOffBits, row_padded, MappedImage::Order::BGR};
+      return {move(file), width, height, (size_t) (bmpFileHeader.bfOffBits + (height - 1) * row_padded), -row_padded,
+              MappedImage::Order::BGR};
+    }
+
+    MappedImage mapBMP(const std::string &bmp) {
+      MappedFile file{bmp};
+
+      BITMAPFILEHEADER bmpFileHeader;
+      BITMAPINFOHEADER bmpInfoHeader;
+      readHeaders(file, bmp, bmpFileHeader, bmpInfoHeader);
+
+      if (bmpInfoHeader.biBitCount != 24)
+        fail("BMP file does not contain supported bit count.", bmp);
+
+      if (bmpInfoHeader.biCompression != BI_RGB)
+        fail("BMP file does not use expected compression method.", bmp);
+
+      return map24(move(file), bmpFileHeader, bmpInfoHeader);
+    }
+
+    // Take the image from the pool when there is one
+    static Image createImage(ImagePool *pool, int width, int height) {
+      return pool ? pool->acquire(width, height) : Image{width, height};
+    }
+
+    static Image decodeBMP(const std::string &bmp, ImagePool *pool) {
+      MappedFile file{bmp};
+
+      BITMAPFILEHEADER bmpFileHeader;
+      BITMAPINFOHEADER bmpInfoHeader;
+      readHeaders(file, bmp, bmpFileHeader, bmpInfoHeader);
+
+      auto bits = bmpInfoHeader.biBitCount;
+      auto compression = bmpInfoHeader.biCompression;
+
+      // 24 bit images are copied straight from the mapping
+      if (bits == 24 && compression == BI_RGB) {
+        auto mapped = map24(move(file), bmpFileHeader, bmpInfoHeader);
+        auto image = createImage(pool, mapped.width, mapped.height);
+        mapped.copyTo(image);
+        return image;
+      }
+
+      auto image = createImage(pool, bmpInfoHeader.biWidth, abs(bmpInfoHeader.biHeight));
+      if (bits == 8 && compression == BI_RGB) {
+        decodePaletted(file, bmp, bmpFileHeader, bmpInfoHeader, image);
+      } else if (bits == 8 && compression == BI_RLE8) {
+        decodeRLE8(file, bmp, bmpFileHeader, bmpInfoHeader, image);
+      } else if ((bits == 16 || bits == 32) && (compression == BI_RGB || compression == BI_BITFIELDS)) {
+        decodeBitfields(file, bmp, bmpFileHeader, bmpInfoHeader, image);
+      } else {
+        stringstream msg;
+        msg << "BMP file uses unsupported format, " << bits << " bits with compression " << compression << ". " << bmp;
+        throw runtime_error(msg.str());
+      }
       return image;
     }
 
-    void saveBMP(ppgso::Image &image, const std::string &bmp) {
-      auto width = image.width;
-      auto height = image.height;
-      auto &framebuffer = image.getFramebuffer();
+    Image loadBMP(const std::string &bmp) {
+      return decodeBMP(bmp, nullptr);
+    }
 
-      unsigned int row_padded = (width * sizeof(Image::Pixel) + 3) & (~3);
+    Image loadBMP(const std::string &bmp, ImagePool &pool) {
+      return decodeBMP(bmp, &pool);
+    }
+
+    size_t writeBMPHeader(std::ostream &output, int width, int height) {
+      size_t row_padded = ((size_t) width * sizeof(Image::Pixel) + 3) & (~3);
+      size_t size = row_padded * height + 122;
+      if (size > numeric_limits<unsigned int>::max()) {
+        stringstream msg;
+        msg << "Image " << width << "x" << height << " is too large for the BMP format.";
+        throw runtime_error(msg.str());
+      }
 
       BITMAPFILEHEADER bmpFileHeader = {};
       bmpFileHeader.bfType = 19778;
-      bmpFileHeader.bfSize = row_padded * height + 122;
+      bmpFileHeader.bfSize = (unsigned int) size;
       bmpFileHeader.bfReserved1 = 0;
       bmpFileHeader.bfReserved2 = 0;
       bmpFileHeader.bfOffBits = 122;
@@ -127,12 +319,24 @@ namespace ppgso {
       bmpInfoHeader.biPlanes = 1;
       bmpInfoHeader.biBitCount = 24;
       bmpInfoHeader.biCompression = 0;
-      bmpInfoHeader.biSizeImage = row_padded * height;
+      bmpInfoHeader.biSizeImage = (unsigned int) (row_padded * height);
       bmpInfoHeader.biXPelsPerMeter = 2835;
       bmpInfoHeader.biYPelsPerMeter = 2835;
       bmpInfoHeader.biClrUsed = 0;
       bmpInfoHeader.biClrImportant = 0;
 
+      output.write((char *) &bmpFileHeader, sizeof(BITMAPFILEHEADER));
+      output.write((char *) &bmpInfoHeader, sizeof(BITMAPINFOHEADER));
+      return bmpFileHeader.bfOffBits;
+    }
+
+    void saveBMP(ppgso::Image &image, const std::string &bmp) {
+      auto width = image.width;
+      auto height = image.height;
+      auto &framebuffer = image.getFramebuffer();
+
+      unsigned int row_padded = (width * sizeof(Image::Pixel) + 3) & (~3);
+
       ofstream output_file(bmp, ios::binary);
 
       if (!output_file.is_open()) {
@@ -141,19 +345,15 @@ namespace ppgso {
         throw runtime_error(msg.str());
       }
 
-      output_file.write((char *) &bmpFileHeader, sizeof(BITMAPFILEHEADER));
-      output_file.write((char *) &bmpInfoHeader, sizeof(BITMAPINFOHEADER));
+      auto offset = writeBMPHeader(output_file, width, height);
 
-      // Prepare BRG output data by swapping RGB to BRG and mirroring along height
-      output_file.seekp(bmpFileHeader.bfOffBits, output_file.beg);
+      // Prepare BGR output data by swapping RGB to BGR and mirroring along height
+      output_file.seekp(offset, output_file.beg);
 
+      // One row buffer is reused for the whole image, padding bytes stay zero
+      vector<uint8_t> output_row(row_padded);
       for (int j = 0; j < height; j++) {
-        auto output_row = vector<Image::Pixel>(row_padded);
-        for (int i = 0; i < width; i++) {
-          auto pixel = framebuffer[i + (height - 1 - j) * width];
-          swap(pixel.r, pixel.b);
-          output_row[i] = pixel;
-        }
+        pixel::swapRedBlue((const uint8_t *) &framebuffer[(height - 1 - j) * width], output_row.data(), width);
         output_file.write((char *) output_row.data(), row_padded);
       }
 
@@ -1,15 +1,45 @@
 #pragma once
+#include <ostream>
 #include "image.h"
+#include "mapped_image.h"
+#include "image_pool.h"
 
 namespace ppgso {
 namespace image {
 /*!
- * Load BMP image from file. Only uncompressed RGB format is supported.
+ * Load BMP image from file. Supports 24 bit RGB, 8 bit paletted with or without RLE8 compression and 16 or 32 bit
+ * images with default or custom channel masks, stored bottom-up or top-down.
  *
  * @param bmp - File path to a BMP image.
  */
   ppgso::Image loadBMP(const std::string &bmp);
 
+/*!
+ * Load BMP image from file into an image taken from the pool, release it to the pool once it is no longer needed.
+ *
+ * @param bmp - File path to a BMP image.
+ * @param pool - Pool providing the image.
+ */
+  ppgso::Image loadBMP(const std::string &bmp, ppgso::ImagePool &pool);
+
+/*!
+ * Map BMP image to memory and access its pixels in place without loading them.
+ * Only uncompressed 24 bit RGB format is supported.
+ *
+ * @param bmp - File path to a BMP image.
+ */
+  ppgso::MappedImage mapBMP(const std::string &bmp);
+
+/*!
+ * Write headers of a 24 bit bottom-up BMP image, pixel rows follow with rows padded to 4 bytes.
+ *
+ * @param output - Stream to write the headers to.
+ * @param width - Width of the image in pixels.
+ * @param height - Height of the image in pixels.
+ * @return - Offset of the pixel data from the start of the file.
+ */
+  size_t writeBMPHeader(std::ostream &output, int width, int height);
+
 /*!
  * Save as BMP image.
  * @param image - Image to save.
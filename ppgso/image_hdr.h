@@ -0,0 +1,145 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace ppgso {
+
+  /*!
+   * RGB pixel stored as three 16 bit floats, half the size of a float pixel with enough range and precision
+   * for high dynamic range colors.
+   */
+  struct HalfPixel {
+    uint16_t r, g, b;
+
+    HalfPixel() : r{0}, g{0}, b{0} {}
+
+    HalfPixel(const glm::vec3 &color)
+        : r{glm::packHalf1x16(color.r)}, g{glm::packHalf1x16(color.g)}, b{glm::packHalf1x16(color.b)} {}
+
+    operator glm::vec3() const {
+      return {glm::unpackHalf1x16(r), glm::unpackHalf1x16(g), glm::unpackHalf1x16(b)};
+    }
+  };
+
+  /*!
+   * Image with arbitrary pixel type, used to keep rendered colors in floating point until they are tone mapped.
+   * Pixel types need to be convertible from and to glm::vec3 for the conversions between image types.
+   */
+  template<typename T>
+  class ImageT {
+  public:
+    using Pixel = T;
+
+    /*!
+     * Create new image with all pixels set to zero.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     */
+    ImageT(int width, int height) : width{width}, height{height} {
+      framebuffer.resize((size_t) (width * height));
+    }
+
+    /*!
+     * Create a copy of an image with a different pixel type.
+     *
+     * @param image - Image to convert.
+     */
+    template<typename U>
+    explicit ImageT(const ImageT<U> &image) : ImageT{image.width, image.height} {
+      auto &source = image.getFramebuffer();
+      for (size_t i = 0; i < framebuffer.size(); ++i)
+        framebuffer[i] = T(glm::vec3(source[i]));
+    }
+
+    /*!
+     * Get raw access to the image data.
+     *
+     * @return - Reference to the pixels stored row by row.
+     */
+    std::vector<T> &getFramebuffer() {
+      return framebuffer;
+    }
+
+    const std::vector<T> &getFramebuffer() const {
+      return framebuffer;
+    }
+
+    /*!
+     * Get single pixel from the framebuffer.
+     *
+     * @param x - X position of the pixel in the framebuffer.
+     * @param y - Y position of the pixel in the framebuffer.
+     * @return - Reference to the pixel.
+     */
+    T &getPixel(int x, int y) {
+      return framebuffer[x + y * width];
+    }
+
+    const T &getPixel(int x, int y) const {
+      return framebuffer[x + y * width];
+    }
+
+    /*!
+     * Set pixel on coordinates x and y
+     * @param x Horizontal coordinate
+     * @param y Vertical coordinate
+     * @param color Pixel color to set
+     */
+    void setPixel(int x, int y, const T &color) {
+      framebuffer[x + y * width] = color;
+    }
+
+    /*!
+     * Clear the image using single color
+     * @param color Pixel color to set the image to
+     */
+    void clear(const T &color = T{}) {
+      std::fill(framebuffer.begin(), framebuffer.end(), color);
+    }
+
+    /*!
+     * Fill a horizontal span of pixels, pixels outside of the image are skipped
+     * @param x Horizontal coordinate of the first pixel
+     * @param y Vertical coordinate
+     * @param length Number of pixels to fill
+     * @param color Pixel color to fill the span with
+     */
+    void fillSpan(int x, int y, int length, const T &color) {
+      fillRect(x, y, length, 1, color);
+    }
+
+    /*!
+     * Fill a rectangle, pixels outside of the image are skipped
+     * @param x Horizontal coordinate of the top left corner
+     * @param y Vertical coordinate of the top left corner
+     * @param width Width of the rectangle
+     * @param height Height of the rectangle
+     * @param color Pixel color to fill the rectangle with
+     */
+    void fillRect(int x, int y, int width, int height, const T &color) {
+      int x0 = std::max(x, 0), y0 = std::max(y, 0);
+      int x1 = std::min(x + width, this->width), y1 = std::min(y + height, this->height);
+      for (int row = y0; row < y1 && x0 < x1; ++row)
+        std::fill_n(framebuffer.begin() + x0 + row * this->width, x1 - x0, color);
+    }
+
+    int width, height;
+  private:
+    std::vector<T> framebuffer;
+  };
+
+  /*!
+   * Image with 32 bit float RGB pixels
+   */
+  using FloatImage = ImageT<glm::vec3>;
+
+  /*!
+   * Image with 16 bit float RGB pixels
+   */
+  using HalfImage = ImageT<HalfPixel>;
+}
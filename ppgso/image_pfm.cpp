@@ -0,0 +1,86 @@
+#include <fstream>
+#include <sstream>
+
+#include "image_pfm.h"
+
+using namespace std;
+
+namespace ppgso {
+  namespace image {
+
+    // PFM files store 32 bit floats in the byte order given by the sign of the scale
+    static bool isLittleEndian() {
+      uint16_t value = 1;
+      return *(uint8_t *) &value == 1;
+    }
+
+    static void swapBytes(float &value) {
+      auto bytes = (uint8_t *) &value;
+      swap(bytes[0], bytes[3]);
+      swap(bytes[1], bytes[2]);
+    }
+
+    FloatImage loadPFM(const string &pfm) {
+      ifstream input_file(pfm, ios::binary);
+
+      if (!input_file.is_open()) {
+        stringstream msg;
+        msg << "Could not open PFM file. " << pfm;
+        throw runtime_error(msg.str());
+      }
+
+      string type;
+      int width = 0, height = 0;
+      double scale = 0;
+      input_file >> type >> width >> height >> scale;
+      // Single whitespace separates the header from the data
+      input_file.get();
+
+      if (!input_file || type != "PF" || width <= 0 || height <= 0 || scale == 0) {
+        stringstream msg;
+        msg << "PFM file does not contain supported PF format. " << pfm;
+        throw runtime_error(msg.str());
+      }
+
+      // Rows are stored from bottom to top
+      FloatImage image{width, height};
+      bool swapped = (scale < 0) != isLittleEndian();
+      for (int y = height - 1; y >= 0; --y) {
+        auto row = &image.getPixel(0, y);
+        input_file.read((char *) row, width * sizeof(glm::vec3));
+        if (swapped) {
+          for (int x = 0; x < width; ++x)
+            for (int c = 0; c < 3; ++c)
+              swapBytes(row[x][c]);
+        }
+      }
+
+      if (!input_file) {
+        stringstream msg;
+        msg << "PFM file is truncated. " << pfm;
+        throw runtime_error(msg.str());
+      }
+      return image;
+    }
+
+    void savePFM(const FloatImage &image, const string &pfm) {
+      ofstream output_file(pfm, ios::binary);
+
+      if (!output_file.is_open()) {
+        stringstream msg;
+        msg << "Could not open PFM file for writing. " << pfm;
+        throw runtime_error(msg.str());
+      }
+
+      output_file << "PF\n" << image.width << " " << image.height << "\n" << (isLittleEndian() ? "-1.0" : "1.0") << "\n";
+      for (int y = image.height - 1; y >= 0; --y)
+        output_file.write((const char *) &image.getPixel(0, y), image.width * sizeof(glm::vec3));
+
+      if (!output_file) {
+        stringstream msg;
+        msg << "Could not write PFM file. " << pfm;
+        throw runtime_error(msg.str());
+      }
+    }
+  }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+
+#include "image_hdr.h"
+
+namespace ppgso {
+  namespace image {
+/*!
+ * Load PFM (portable float map) image from file. Only the color "PF" variant is supported.
+ *
+ * @param pfm - File path to a PFM image.
+ */
+  ppgso::FloatImage loadPFM(const std::string &pfm);
+
+/*!
+ * Save as little endian color PFM image, the format keeps the full float range of the pixels.
+ * @param image - Image to save.
+ * @param pfm - Name of the PFM file to save image to.
+ */
+  void savePFM(const ppgso::FloatImage &image, const std::string &pfm);
+ }
+}
@@ -0,0 +1,125 @@
+#include <sstream>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <cctype>
+
+#include "image_pipeline.h"
+#include "image_bmp.h"
+#include "image_raw.h"
+#include "bounded_queue.h"
+
+using namespace std;
+using namespace ppgso;
+
+// Case insensitive check of the file extension
+static bool hasExtension(const string &file, const string &extension) {
+  if (file.size() < extension.size()) return false;
+  auto offset = file.size() - extension.size();
+  for (size_t i = 0; i < extension.size(); ++i)
+    if (tolower((unsigned char) file[offset + i]) != extension[i]) return false;
+  return true;
+}
+
+ImagePipeline::ImagePipeline(unsigned int threads, size_t queueSize, unsigned int ioThreads)
+    : pool{threads}, queueSize{queueSize}, ioThreads{ioThreads ? ioThreads : 1} {}
+
+void ImagePipeline::setRawSize(int width, int height) {
+  rawWidth = width;
+  rawHeight = height;
+}
+
+Image ImagePipeline::load(const string &file) const {
+  if (hasExtension(file, ".bmp")) return image::loadBMP(file);
+  if (hasExtension(file, ".raw")) return image::loadRAW(file, rawWidth, rawHeight);
+
+  stringstream msg;
+  msg << "Unsupported image format, use .bmp or .raw files. " << file;
+  throw runtime_error(msg.str());
+}
+
+Image ImagePipeline::load(const string &file, ImagePool &pool) const {
+  if (hasExtension(file, ".bmp")) return image::loadBMP(file, pool);
+  if (hasExtension(file, ".raw")) return image::loadRAW(file, rawWidth, rawHeight, pool);
+  return load(file);
+}
+
+void ImagePipeline::save(Image &image, const string &file) const {
+  if (hasExtension(file, ".bmp")) return image::saveBMP(image, file);
+  if (hasExtension(file, ".raw")) return image::saveRAW(image, file);
+
+  stringstream msg;
+  msg << "Unsupported image format, use .bmp or .raw files. " << file;
+  throw runtime_error(msg.str());
+}
+
+void ImagePipeline::run(const vector<Job> &jobs, const Process &process) {
+  // Images travel between stages together with the index of their job
+  struct Item {
+    size_t job;
+    Image image{0, 0};
+  };
+  BoundedQueue<Item> loaded{queueSize}, processed{queueSize};
+
+  // The first failure closes both queues so every stage stops waiting and returns
+  mutex errorMutex;
+  exception_ptr error;
+  auto fail = [&] {
+    {
+      lock_guard<std::mutex> lock{errorMutex};
+      if (!error) error = current_exception();
+    }
+    loaded.close();
+    processed.close();
+  };
+
+  // Loaders take jobs in order so files are read mostly sequentially
+  atomic<size_t> next{0};
+  atomic<unsigned int> loading{ioThreads};
+  vector<thread> io;
+  for (unsigned int i = 0; i < ioThreads; ++i) {
+    io.emplace_back([&] {
+      try {
+        for (size_t job = next++; job < jobs.size(); job = next++) {
+          // Saved images return to the pool so their memory is reused instead of allocated for every file
+          if (!loaded.push({job, load(jobs[job].input, images)})) break;
+        }
+      } catch (...) {
+        fail();
+      }
+      if (--loading == 0) loaded.close();
+    });
+  }
+
+  for (unsigned int i = 0; i < ioThreads; ++i) {
+    io.emplace_back([&] {
+      try {
+        Item item;
+        while (processed.pop(item)) {
+          save(item.image, jobs[item.job].output);
+          images.release(move(item.image));
+        }
+      } catch (...) {
+        fail();
+      }
+    });
+  }
+
+  // Every pool thread keeps processing images until the loaders are done
+  pool.run(pool.getThreadCount(), [&](size_t, unsigned int) {
+    try {
+      Item item;
+      while (loaded.pop(item)) {
+        if (process) process(item.image);
+        if (!processed.push(move(item))) break;
+      }
+    } catch (...) {
+      fail();
+    }
+  });
+  processed.close();
+
+  for (auto &thread : io)
+    thread.join();
+  if (error) rethrow_exception(error);
+}
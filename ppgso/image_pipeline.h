@@ -0,0 +1,89 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "image.h"
+#include "thread_pool.h"
+#include "image_pool.h"
+
+namespace ppgso {
+
+  /*!
+   * Converts a batch of BMP and RAW images. Images are loaded, processed and saved by separate stages connected
+   * with bounded queues, so reading and writing files overlaps with processing on a thread pool while only a few
+   * images are in memory at a time. The file format is chosen by the file extension.
+   */
+  class ImagePipeline {
+  public:
+    /*!
+     * Single image to convert
+     */
+    struct Job {
+      std::string input, output;
+    };
+
+    /*!
+     * Operation applied to every image between loading and saving
+     */
+    using Process = std::function<void(Image &image)>;
+
+    /*!
+     * Create a pipeline with its own thread pool.
+     *
+     * @param threads - Number of threads processing images, 0 uses all hardware threads.
+     * @param queueSize - Number of images waiting between two stages.
+     * @param ioThreads - Number of threads loading and the number of threads saving images.
+     */
+    explicit ImagePipeline(unsigned int threads = 0, size_t queueSize = 4, unsigned int ioThreads = 1);
+
+    /*!
+     * Set size of RAW images, RAW files do not store it.
+     *
+     * @param width - Width of RAW images in pixels.
+     * @param height - Height of RAW images in pixels.
+     */
+    void setRawSize(int width, int height);
+
+    /*!
+     * Convert all images and wait until they are saved.
+     * The first exception thrown by any stage stops the pipeline and is rethrown.
+     *
+     * @param jobs - Images to convert, they are processed in no particular order.
+     * @param process - Operation applied to each image, may be empty.
+     */
+    void run(const std::vector<Job> &jobs, const Process &process);
+
+    /*!
+     * Load a BMP or RAW image depending on the file extension.
+     *
+     * @param file - File to load.
+     * @return - Loaded image.
+     */
+    Image load(const std::string &file) const;
+
+    /*!
+     * Save a BMP or RAW image depending on the file extension.
+     *
+     * @param image - Image to save.
+     * @param file - File to save to.
+     */
+    void save(Image &image, const std::string &file) const;
+
+    /*!
+     * Load a BMP or RAW image depending on the file extension into an image taken from the pool.
+     *
+     * @param file - File to load.
+     * @param pool - Pool providing the image.
+     * @return - Loaded image.
+     */
+    Image load(const std::string &file, ImagePool &pool) const;
+
+  private:
+    ThreadPool pool;
+    ImagePool images;
+    size_t queueSize;
+    unsigned int ioThreads;
+    int rawWidth = 512, rawHeight = 512;
+  };
+}
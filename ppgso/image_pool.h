@@ -0,0 +1,181 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "image.h"
+#include "image_hdr.h"
+
+namespace ppgso {
+
+  /*!
+   * Keeps released images and hands them out again when an image of the same size is requested, so passes that
+   * need a new image for every frame, file or tile reuse memory that is already allocated and paged in.
+   * Recycled images keep the pixels of their previous use. The pool is safe to use from multiple threads.
+   */
+  template<typename ImageType>
+  class ImagePoolT {
+  public:
+    /*!
+     * Image borrowed from the pool, it returns to the pool when the lease is destroyed
+     */
+    class Lease {
+    public:
+      Lease(ImagePoolT *pool, ImageType &&image) : pool{pool}, image{std::move(image)} {}
+
+      Lease(Lease &&other) : pool{other.pool}, image{std::move(other.image)} {
+        other.pool = nullptr;
+      }
+
+      Lease(const Lease &) = delete;
+      Lease &operator=(const Lease &) = delete;
+
+      ~Lease() {
+        if (pool) pool->release(std::move(image));
+      }
+
+      ImageType &operator*() {
+        return image;
+      }
+
+      ImageType *operator->() {
+        return &image;
+      }
+
+    private:
+      ImagePoolT *pool;
+      ImageType image;
+    };
+
+    /*!
+     * Create an empty pool.
+     *
+     * @param maxImages - Maximum number of released images kept for each size, others are freed.
+     */
+    explicit ImagePoolT(size_t maxImages = 16) : maxImages{maxImages} {}
+
+    /*!
+     * Get an image of the requested size, a released image is reused when available.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @return - Image to give back using release once it is no longer needed.
+     */
+    ImageType acquire(int width, int height) {
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto &images = free[{width, height}];
+        if (!images.empty()) {
+          ImageType image{std::move(images.back())};
+          images.pop_back();
+          return image;
+        }
+      }
+      return ImageType{width, height};
+    }
+
+    /*!
+     * Get an image of the requested size that is released automatically.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @return - Image that is returned to the pool once the lease is destroyed.
+     */
+    Lease lease(int width, int height) {
+      return {this, acquire(width, height)};
+    }
+
+    /*!
+     * Give an image to the pool so later requests of the same size can reuse it.
+     *
+     * @param image - Image to release.
+     */
+    void release(ImageType &&image) {
+      std::lock_guard<std::mutex> lock{mutex};
+      auto &images = free[{image.width, image.height}];
+      if (images.size() < maxImages && !image.getFramebuffer().empty()) images.push_back(std::move(image));
+    }
+
+    /*!
+     * Free all released images.
+     */
+    void clear() {
+      std::lock_guard<std::mutex> lock{mutex};
+      free.clear();
+    }
+
+    /*!
+     * Get number of released images waiting for reuse.
+     *
+     * @return - Number of images in the pool.
+     */
+    size_t size() {
+      std::lock_guard<std::mutex> lock{mutex};
+      size_t count = 0;
+      for (auto &images : free)
+        count += images.second.size();
+      return count;
+    }
+
+  private:
+    size_t maxImages;
+    std::mutex mutex;
+    std::map<std::pair<int, int>, std::vector<ImageType>> free;
+  };
+
+  /*!
+   * Scratch images for a single frame. Images are handed out in order and all of them become available again
+   * after reset, so a frame that requests the same images every time allocates only during the first frame.
+   * Images keep the pixels of the previous frame. The arena is not thread safe.
+   */
+  template<typename ImageType>
+  class ImageArenaT {
+  public:
+    /*!
+     * Get the next scratch image, references stay valid until the arena is destroyed.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @return - Reference to an image of the requested size.
+     */
+    ImageType &allocate(int width, int height) {
+      if (used == images.size()) {
+        images.emplace_back(new ImageType{width, height});
+      } else if (images[used]->width != width || images[used]->height != height) {
+        // The frame requests images in a different order or size, replace the image in this slot
+        images[used].reset(new ImageType{width, height});
+      }
+      return *images[used++];
+    }
+
+    /*!
+     * Make all images available again, call at the start of every frame.
+     */
+    void reset() {
+      used = 0;
+    }
+
+    /*!
+     * Get number of images allocated since the last reset.
+     *
+     * @return - Number of images in use.
+     */
+    size_t size() const {
+      return used;
+    }
+
+  private:
+    std::vector<std::unique_ptr<ImageType>> images;
+    size_t used = 0;
+  };
+
+  /*!
+   * Pools and arenas for the 8 bit and floating point images
+   */
+  using ImagePool = ImagePoolT<Image>;
+  using FloatImagePool = ImagePoolT<FloatImage>;
+  using ImageArena = ImageArenaT<Image>;
+  using FloatImageArena = ImageArenaT<FloatImage>;
+}
@@ -1,15 +1,47 @@
 #include <fstream>
 #include <sstream>
 
-#include "image.h"
+#include "image_raw.h"
 
 using namespace std;
 
 namespace ppgso {
   namespace image {
 
+    MappedImage mapRAW(const string &raw, int width, int height) {
+      // Rows are stored top to bottom without padding
+      return {MappedFile{raw}, width, height, 0, (ptrdiff_t) (width * sizeof(Image::Pixel)), MappedImage::Order::RGB};
+    }
+
     Image loadRAW(const string &raw, int width, int height) {
-      Image image{width, height};
+      return mapRAW(raw, width, height).toImage();
+    }
+
+    Image loadRAW(const string &raw, int width, int height, ImagePool &pool) {
+      auto mapped = mapRAW(raw, width, height);
+      auto image = pool.acquire(width, height);
+      mapped.copyTo(image);
+      return image;
+    }
+
+    void saveRAW(Image &image, const string &raw) {
+      ofstream image_stream(raw, ios::binary);
+
+      if (!image_stream.is_open()) {
+        stringstream msg;
+        msg << "Could not open image " << raw;
+        throw runtime_error(msg.str());
+      }
+
+      auto &framebuffer = image.getFramebuffer();
+
+      // Save the data
+      image_stream.write((char *) framebuffer.data(), framebuffer.size() * sizeof(Image::Pixel));
+      image_stream.close();
+    }
+
+    FloatImage loadRAWFloat(const string &raw, int width, int height) {
+      FloatImage image{width, height};
       auto &framebuffer = image.getFramebuffer();
 
       // Open file stream
@@ -22,12 +54,12 @@ namespace ppgso {
       }
 
       // Load the data
-      image_stream.read((char *) framebuffer.data(), framebuffer.size() * sizeof(Image::Pixel));
+      image_stream.read((char *) framebuffer.data(), framebuffer.size() * sizeof(FloatImage::Pixel));
       image_stream.close();
       return image;
     }
 
-    void saveRAW(Image &image, const string &raw) {
+    void saveRAW(const FloatImage &image, const string &raw) {
       ofstream image_stream(raw, ios::binary);
 
       if (!image_stream.is_open()) {
@@ -39,7 +71,7 @@ namespace ppgso {
       auto &framebuffer = image.getFramebuffer();
 
       // Save the data
-      image_stream.write((char *) framebuffer.data(), framebuffer.size() * sizeof(Image::Pixel));
+      image_stream.write((const char *) framebuffer.data(), framebuffer.size() * sizeof(FloatImage::Pixel));
       image_stream.close();
     }
 
@@ -1,5 +1,8 @@
 #pragma once
 #include "image.h"
+#include "image_hdr.h"
+#include "mapped_image.h"
+#include "image_pool.h"
 
 namespace ppgso {
   namespace image {
@@ -10,11 +13,40 @@ namespace ppgso {
  */
   ppgso::Image loadRAW(const std::string &raw, int width, int height);
 
+/*!
+ * Load RAW image from file into an image taken from the pool, release it to the pool once it is no longer needed.
+ *
+ * @param raw - File path to a RAW image.
+ * @param pool - Pool providing the image.
+ */
+  ppgso::Image loadRAW(const std::string &raw, int width, int height, ppgso::ImagePool &pool);
+
+/*!
+ * Map RAW image to memory and access its pixels in place without loading them.
+ *
+ * @param raw - File path to a RAW image.
+ */
+  ppgso::MappedImage mapRAW(const std::string &raw, int width, int height);
+
 /*!
  * Save as RAW image.
  * @param image - Image to save.
  * @param raw - Name of the RAW file to save image to.
  */
   void saveRAW(ppgso::Image &image, const std::string &raw);
+
+/*!
+ * Load RAW image with 32 bit float RGB pixels from file.
+ *
+ * @param raw - File path to a RAW image.
+ */
+  ppgso::FloatImage loadRAWFloat(const std::string &raw, int width, int height);
+
+/*!
+ * Save as RAW image with 32 bit float RGB pixels in native byte order.
+ * @param image - Image to save.
+ * @param raw - Name of the RAW file to save image to.
+ */
+  void saveRAW(const ppgso::FloatImage &image, const std::string &raw);
  }
 }
@@ -0,0 +1,92 @@
+#include <sstream>
+#include <stdexcept>
+
+#include "image_writer.h"
+#include "image_bmp.h"
+#include "pixel_convert.h"
+
+using namespace std;
+using namespace ppgso;
+
+ImageWriter::ImageWriter(const string &file, int width, int height, Format format)
+    : width{width}, height{height}, file{file}, format{format} {
+  if (width <= 0 || height <= 0) {
+    stringstream msg;
+    msg << "Image size " << width << "x" << height << " is not positive. " << file;
+    throw runtime_error(msg.str());
+  }
+
+  output.open(file, ios::binary);
+  if (!output.is_open()) {
+    stringstream msg;
+    msg << "Could not open image for writing. " << file;
+    throw runtime_error(msg.str());
+  }
+
+  if (format == Format::BMP) {
+    offset = image::writeBMPHeader(output, width, height);
+    rowSize = ((size_t) width * sizeof(Image::Pixel) + 3) & (~3);
+  } else {
+    offset = 0;
+    rowSize = (size_t) width * sizeof(Image::Pixel);
+  }
+
+  // Extend the file to its final size, the gap reads back as zeros
+  output.seekp((streamoff) (offset + rowSize * height - 1), ios::beg);
+  output.put(0);
+  row.resize(rowSize);
+}
+
+void ImageWriter::writeRow(int y, const Image::Pixel *pixels) {
+  writeTile({0, y, width, 1}, pixels, (size_t) width);
+}
+
+void ImageWriter::writeTile(const Tile &tile, const Image::Pixel *pixels, size_t stride) {
+  if (tile.x < 0 || tile.y < 0 || tile.width < 0 || tile.height < 0 || tile.x + tile.width > width ||
+      tile.y + tile.height > height) {
+    stringstream msg;
+    msg << "Tile " << tile.x << "," << tile.y << " " << tile.width << "x" << tile.height << " is outside of image "
+        << file;
+    throw runtime_error(msg.str());
+  }
+
+  // A single stream is shared so only one tile is written at a time
+  lock_guard<std::mutex> lock{mutex};
+  auto bytes = (size_t) tile.width * sizeof(Image::Pixel);
+  for (int j = 0; j < tile.height; ++j) {
+    auto y = tile.y + j;
+    auto source = pixels + j * stride;
+    auto position = offset + (size_t) tile.x * sizeof(Image::Pixel);
+    if (format == Format::BMP) {
+      // BMP rows are stored bottom-up in BGR order
+      position += (size_t) (height - 1 - y) * rowSize;
+      pixel::swapRedBlue((const uint8_t *) source, row.data(), (size_t) tile.width);
+      source = (const Image::Pixel *) row.data();
+    } else {
+      position += (size_t) y * rowSize;
+    }
+    output.seekp((streamoff) position, ios::beg);
+    output.write((const char *) source, bytes);
+  }
+
+  if (!output) {
+    stringstream msg;
+    msg << "Could not write image " << file;
+    throw runtime_error(msg.str());
+  }
+}
+
+void ImageWriter::writeTile(const Tile &tile, Image &pixels) {
+  writeTile(tile, pixels.getFramebuffer().data(), (size_t) pixels.width);
+}
+
+void ImageWriter::close() {
+  lock_guard<std::mutex> lock{mutex};
+  if (!output.is_open()) return;
+  output.close();
+  if (!output) {
+    stringstream msg;
+    msg << "Could not write image " << file;
+    throw runtime_error(msg.str());
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fstream>
+
+#include "image.h"
+#include "tile_scheduler.h"
+
+namespace ppgso {
+
+  /*!
+   * Writes an image to a file piece by piece so the whole image never has to be in memory.
+   * Rows and tiles can be written in any order and from multiple threads, each one is stored at its final position
+   * in the file. Pixels that are never written stay black.
+   */
+  class ImageWriter {
+  public:
+    /*!
+     * Supported file formats
+     */
+    enum class Format {
+      RAW,  // Uncompressed RGB rows stored top to bottom, same as image::saveRAW
+      BMP   // 24 bit BMP with rows stored bottom-up, same as image::saveBMP
+    };
+
+    /*!
+     * Create the file and reserve space for the whole image. Throws runtime_error when the size is not positive.
+     *
+     * @param file - Name of the file to write to.
+     * @param width - Width of the image in pixels.
+     * @param height - Height of the image in pixels.
+     * @param format - Format of the file.
+     */
+    ImageWriter(const std::string &file, int width, int height, Format format);
+
+    ImageWriter(const ImageWriter &) = delete;
+    ImageWriter &operator=(const ImageWriter &) = delete;
+
+    /*!
+     * Write a single row of the image.
+     *
+     * @param y - Row to write, 0 is the top of the image.
+     * @param pixels - Pixels of the row, width of the image pixels are read.
+     */
+    void writeRow(int y, const Image::Pixel *pixels);
+
+    /*!
+     * Write a rectangular region of the image.
+     *
+     * @param tile - Region of the image to write, must be inside the image.
+     * @param pixels - First pixel of the region.
+     * @param stride - Distance between rows of the region in pixels.
+     */
+    void writeTile(const Tile &tile, const Image::Pixel *pixels, size_t stride);
+
+    /*!
+     * Write a rectangular region of the image stored as a separate image of the same size as the region.
+     *
+     * @param tile - Region of the image to write, must be inside the image.
+     * @param pixels - Image holding the pixels of the region.
+     */
+    void writeTile(const Tile &tile, Image &pixels);
+
+    /*!
+     * Flush all written data to the file, the file is also closed when the writer is destroyed.
+     */
+    void close();
+
+    int width, height;
+  private:
+    std::string file;
+    Format format;
+    std::ofstream output;
+    size_t offset, rowSize;
+    std::mutex mutex;
+    std::vector<uint8_t> row;
+  };
+}
@@ -0,0 +1,108 @@
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+using namespace std;
+using namespace ppgso;
+
+MappedFile::MappedFile(const string &file) {
+#ifdef _WIN32
+  HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  LARGE_INTEGER fileSize;
+  if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &fileSize)) {
+    if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+    stringstream msg;
+    msg << "Could not open file " << file;
+    throw runtime_error(msg.str());
+  }
+
+  length = (size_t) fileSize.QuadPart;
+  if (length > 0) {
+    HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+      contents = (const uint8_t *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(handle);
+#else
+  int descriptor = open(file.c_str(), O_RDONLY);
+  struct stat status = {};
+  if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+    if (descriptor >= 0) close(descriptor);
+    stringstream msg;
+    msg << "Could not open file " << file;
+    throw runtime_error(msg.str());
+  }
+
+  length = (size_t) status.st_size;
+  if (length > 0) {
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address != MAP_FAILED) {
+      contents = (const uint8_t *) address;
+      // The whole file is usually read front to back
+      madvise(address, length, MADV_SEQUENTIAL);
+    }
+  }
+  close(descriptor);
+#endif
+
+  if (length > 0 && !contents) {
+    stringstream msg;
+    msg << "Could not map file " << file;
+    throw runtime_error(msg.str());
+  }
+}
+
+MappedFile::~MappedFile() {
+  unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : contents{other.contents}, length{other.length} {
+  other.contents = nullptr;
+  other.length = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    contents = other.contents;
+    length = other.length;
+    other.contents = nullptr;
+    other.length = 0;
+  }
+  return *this;
+}
+
+const uint8_t *MappedFile::data() const {
+  return contents;
+}
+
+size_t MappedFile::size() const {
+  return length;
+}
+
+void MappedFile::unmap() {
+  if (!contents) return;
+#ifdef _WIN32
+  UnmapViewOfFile(contents);
+#else
+  munmap((void *) contents, length);
+#endif
+  contents = nullptr;
+  length = 0;
+}
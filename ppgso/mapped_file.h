@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace ppgso {
+
+  /*!
+   * Read only memory mapping of a whole file.
+   *
+   * The operating system pages the file in on demand, so the contents can be used in place without copying them
+   * to a buffer first. The mapping stays valid for the lifetime of the object.
+   */
+  class MappedFile {
+  public:
+    /*!
+     * Map a file to memory.
+     *
+     * @param file - Path to the file to map.
+     */
+    explicit MappedFile(const std::string &file);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    /*!
+     * Get the mapped contents.
+     *
+     * @return - Pointer to the first byte of the file or nullptr for empty files.
+     */
+    const uint8_t *data() const;
+
+    /*!
+     * Get size of the file.
+     *
+     * @return - Size in bytes.
+     */
+    size_t size() const;
+
+  private:
+    const uint8_t *contents = nullptr;
+    size_t length = 0;
+
+    void unmap();
+  };
+}
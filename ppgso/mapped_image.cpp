@@ -0,0 +1,53 @@
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+#include "mapped_image.h"
+#include "pixel_convert.h"
+
+using namespace std;
+using namespace ppgso;
+
+MappedImage::MappedImage(MappedFile file, int width, int height, size_t offset, ptrdiff_t stride, Order order)
+    : width{width}, height{height}, file{move(file)}, stride{stride}, order{order} {
+  // Both the top and the bottom row need to lie inside the file
+  auto rowSize = (size_t) width * sizeof(Image::Pixel);
+  auto last = (ptrdiff_t) offset + (ptrdiff_t) (height - 1) * stride;
+  if (width <= 0 || height <= 0 || last < 0 || offset + rowSize > this->file.size() ||
+      (size_t) last + rowSize > this->file.size()) {
+    stringstream msg;
+    msg << "Image data " << width << "x" << height << " does not fit the mapped file of " << this->file.size() << " bytes";
+    throw runtime_error(msg.str());
+  }
+  top = this->file.data() + offset;
+}
+
+MappedImage::Order MappedImage::getOrder() const {
+  return order;
+}
+
+void MappedImage::copyTo(Image &image) const {
+  if (image.width != width || image.height != height) {
+    stringstream msg;
+    msg << "Image size " << image.width << "x" << image.height << " does not match mapped image " << width << "x" << height;
+    throw runtime_error(msg.str());
+  }
+
+  auto rowSize = (size_t) width * sizeof(Image::Pixel);
+  auto target = (uint8_t *) image.getFramebuffer().data();
+
+  // Continuous RGB data is copied at once
+  if (order == Order::RGB && stride == (ptrdiff_t) rowSize) {
+    memcpy(target, top, rowSize * height);
+    return;
+  }
+
+  // Convert all rows in one pass, bottom-up files are flipped by the negative stride
+  pixel::copyRows(top, stride, target, (ptrdiff_t) rowSize, (size_t) width, (size_t) height, order == Order::BGR);
+}
+
+Image MappedImage::toImage() const {
+  Image image{width, height};
+  copyTo(image);
+  return image;
+}
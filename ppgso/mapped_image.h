@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+
+#include "image.h"
+#include "mapped_file.h"
+
+namespace ppgso {
+
+  /*!
+   * Uncompressed RGB image accessed in place inside a memory mapped file.
+   *
+   * Rows are addressed top to bottom regardless of the order they are stored in the file, files stored bottom-up
+   * simply use a negative stride. Use image::mapBMP or image::mapRAW to open a file.
+   */
+  class MappedImage {
+  public:
+    /*!
+     * Order of the color channels in the file
+     */
+    enum class Order {
+      RGB,
+      BGR
+    };
+
+    /*!
+     * Create view of pixel data inside a mapped file, the data is checked to fit the file.
+     *
+     * @param file - Mapped file, the view takes ownership.
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @param offset - Offset of the top row in bytes.
+     * @param stride - Distance between the starts of two successive rows in bytes, negative for bottom-up files.
+     * @param order - Order of the color channels.
+     */
+    MappedImage(MappedFile file, int width, int height, size_t offset, std::ptrdiff_t stride, Order order);
+
+    /*!
+     * Get pixels of a row without any conversion.
+     *
+     * @param y - Row counted from the top of the image.
+     * @return - Pointer to the first pixel of the row, channels are stored in getOrder.
+     */
+    const Image::Pixel *getRow(int y) const {
+      return (const Image::Pixel *) (top + y * stride);
+    }
+
+    /*!
+     * Get order of the color channels.
+     *
+     * @return - Channel order of the pixels returned by getRow.
+     */
+    Order getOrder() const;
+
+    /*!
+     * Convert the pixels to RGB and copy them to an image of the same size in a single pass.
+     *
+     * @param image - Image to copy to.
+     */
+    void copyTo(Image &image) const;
+
+    /*!
+     * Convert the pixels to a new RGB image.
+     *
+     * @return - New image.
+     */
+    Image toImage() const;
+
+    int width, height;
+  private:
+    MappedFile file;
+    const uint8_t *top;
+    std::ptrdiff_t stride;
+    Order order;
+  };
+}
@@ -0,0 +1,266 @@
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+#include "cpu.h"
+#include "pixel_convert.h"
+
+#ifdef PPGSO_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace ppgso {
+  namespace pixel {
+
+    using ConvertFunction = void (*)(const uint8_t *, uint8_t *, size_t);
+    using FillFunction = void (*)(uint8_t *, const uint8_t *, size_t);
+    using FillFloatFunction = void (*)(float *, float, size_t);
+
+    static void swapScalar(const uint8_t *source, uint8_t *target, size_t count) {
+      for (size_t i = 0; i < count * 3; i += 3) {
+        uint8_t first = source[i];
+        target[i] = source[i + 2];
+        target[i + 1] = source[i + 1];
+        target[i + 2] = first;
+      }
+    }
+
+    static void bgraScalar(const uint8_t *source, uint8_t *target, size_t count) {
+      for (size_t i = 0; i < count; ++i) {
+        target[i * 3] = source[i * 4 + 2];
+        target[i * 3 + 1] = source[i * 4 + 1];
+        target[i * 3 + 2] = source[i * 4];
+      }
+    }
+
+    static void fillScalar(uint8_t *target, const uint8_t *color, size_t count) {
+      for (size_t i = 0; i < count * 3; i += 3) {
+        target[i] = color[0];
+        target[i + 1] = color[1];
+        target[i + 2] = color[2];
+      }
+    }
+
+    static void fillFloatScalar(float *target, float value, size_t count) {
+      std::fill(target, target + count, value);
+    }
+
+#ifdef PPGSO_X86
+    // Each block of 16 bytes swaps 5 pixels, the last byte belongs to the next pixel and is kept. Blocks overlap
+    // by that byte and it is written back unchanged before the next block is loaded, so conversion works in place
+    PPGSO_TARGET("ssse3")
+    static void swapSSSE3(const uint8_t *source, uint8_t *target, size_t count) {
+      __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+      size_t bytes = count * 3, i = 0;
+      for (; i + 16 <= bytes; i += 15) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (source + i));
+        _mm_storeu_si128((__m128i *) (target + i), _mm_shuffle_epi8(block, mask));
+      }
+      swapScalar(source + i, target + i, (bytes - i) / 3);
+    }
+
+    // Same as SSSE3 with the two halves of the register 15 bytes apart, memory operands of the lane insert and
+    // extract instructions do not compete with the shuffle for the same execution port
+    PPGSO_TARGET("avx2")
+    static void swapAVX2(const uint8_t *source, uint8_t *target, size_t count) {
+      __m128i half = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+      __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(half), half, 1);
+      size_t bytes = count * 3, i = 0;
+      for (; i + 31 <= bytes; i += 30) {
+        __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (source + i))),
+                                                _mm_loadu_si128((const __m128i *) (source + i + 15)), 1);
+        block = _mm256_shuffle_epi8(block, mask);
+        _mm_storeu_si128((__m128i *) (target + i), _mm256_castsi256_si128(block));
+        _mm_storeu_si128((__m128i *) (target + i + 15), _mm256_extracti128_si256(block, 1));
+      }
+      swapScalar(source + i, target + i, (bytes - i) / 3);
+    }
+
+    // Converts 4 pixels to 12 bytes, the remaining 4 bytes of the store are overwritten by the next block
+    PPGSO_TARGET("ssse3")
+    static void bgraSSSE3(const uint8_t *source, uint8_t *target, size_t count) {
+      __m128i mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+      size_t i = 0;
+      for (; (i + 4) * 3 + 4 <= count * 3; i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (source + i * 4));
+        _mm_storeu_si128((__m128i *) (target + i * 3), _mm_shuffle_epi8(block, mask));
+      }
+      bgraScalar(source + i * 4, target + i * 3, count - i);
+    }
+
+    // Converts 8 pixels, each half of the register is packed to 12 bytes and the halves are joined to 24 bytes
+    PPGSO_TARGET("avx2")
+    static void bgraAVX2(const uint8_t *source, uint8_t *target, size_t count) {
+      __m256i mask = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+      __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+      size_t i = 0;
+      for (; (i + 8) * 3 + 8 <= count * 3; i += 8) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (source + i * 4));
+        block = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(block, mask), pack);
+        _mm256_storeu_si256((__m256i *) (target + i * 3), block);
+      }
+      bgraScalar(source + i * 4, target + i * 3, count - i);
+    }
+
+    // 16 pixels are 48 bytes, the color pattern repeats every three registers. Only needs SSE2 but is selected
+    // together with the other SSSE3 kernels
+    PPGSO_TARGET("sse2")
+    static void fillSSE2(uint8_t *target, const uint8_t *color, size_t count) {
+      uint8_t pattern[48];
+      for (int i = 0; i < 48; ++i)
+        pattern[i] = color[i % 3];
+      __m128i a = _mm_loadu_si128((const __m128i *) pattern);
+      __m128i b = _mm_loadu_si128((const __m128i *) (pattern + 16));
+      __m128i c = _mm_loadu_si128((const __m128i *) (pattern + 32));
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16) {
+        auto block = target + i * 3;
+        _mm_storeu_si128((__m128i *) block, a);
+        _mm_storeu_si128((__m128i *) (block + 16), b);
+        _mm_storeu_si128((__m128i *) (block + 32), c);
+      }
+      fillScalar(target + i * 3, color, count - i);
+    }
+
+    PPGSO_TARGET("sse2")
+    static void fillFloatSSE2(float *target, float value, size_t count) {
+      __m128 block = _mm_set1_ps(value);
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(target + i, block);
+      fillFloatScalar(target + i, value, count - i);
+    }
+
+    // 32 pixels are 96 bytes, three registers as in the SSE2 version
+    PPGSO_TARGET("avx2")
+    static void fillAVX2(uint8_t *target, const uint8_t *color, size_t count) {
+      uint8_t pattern[96];
+      for (int i = 0; i < 96; ++i)
+        pattern[i] = color[i % 3];
+      __m256i a = _mm256_loadu_si256((const __m256i *) pattern);
+      __m256i b = _mm256_loadu_si256((const __m256i *) (pattern + 32));
+      __m256i c = _mm256_loadu_si256((const __m256i *) (pattern + 64));
+      size_t i = 0;
+      for (; i + 32 <= count; i += 32) {
+        auto block = target + i * 3;
+        _mm256_storeu_si256((__m256i *) block, a);
+        _mm256_storeu_si256((__m256i *) (block + 32), b);
+        _mm256_storeu_si256((__m256i *) (block + 64), c);
+      }
+      fillSSE2(target + i * 3, color, count - i);
+    }
+
+    // Stores are aligned to 32 bytes so none of them is split between two cache lines
+    PPGSO_TARGET("avx2")
+    static void fillFloatAVX2(float *target, float value, size_t count) {
+      __m256 block = _mm256_set1_ps(value);
+      size_t i = 0;
+      for (; i < count && ((uintptr_t) (target + i) & 31); ++i)
+        target[i] = value;
+      for (; i + 8 <= count; i += 8)
+        _mm256_store_ps(target + i, block);
+      fillFloatScalar(target + i, value, count - i);
+    }
+#endif
+
+    static atomic<Kernel> selected{Kernel::Automatic};
+    static atomic<ConvertFunction> swapFunction{nullptr};
+    static atomic<ConvertFunction> bgraFunction{nullptr};
+    static atomic<FillFunction> fillFunction{nullptr};
+    static atomic<FillFloatFunction> fillFloatFunction{nullptr};
+
+    void setKernel(Kernel kernel) {
+      if (kernel == Kernel::AVX2 && !cpu::hasAVX2()) kernel = Kernel::Automatic;
+      if (kernel == Kernel::SSSE3 && !cpu::hasSSSE3()) kernel = Kernel::Automatic;
+      if (kernel == Kernel::Automatic)
+        kernel = cpu::hasAVX2() ? Kernel::AVX2 : cpu::hasSSSE3() ? Kernel::SSSE3 : Kernel::Scalar;
+
+      ConvertFunction swap = swapScalar, bgra = bgraScalar;
+      FillFunction fill = fillScalar;
+      FillFloatFunction fillFloat = fillFloatScalar;
+#ifdef PPGSO_X86
+      if (kernel == Kernel::AVX2) {
+        swap = swapAVX2;
+        bgra = bgraAVX2;
+        fill = fillAVX2;
+        fillFloat = fillFloatAVX2;
+      }
+      if (kernel == Kernel::SSSE3) {
+        swap = swapSSSE3;
+        bgra = bgraSSSE3;
+        fill = fillSSE2;
+        fillFloat = fillFloatSSE2;
+      }
+#endif
+      selected = kernel;
+      bgraFunction = bgra;
+      fillFunction = fill;
+      fillFloatFunction = fillFloat;
+      swapFunction = swap;
+    }
+
+    string getKernelName() {
+      if (!swapFunction.load()) setKernel(Kernel::Automatic);
+      switch (selected.load()) {
+        case Kernel::AVX2:
+          return "AVX2";
+        case Kernel::SSSE3:
+          return "SSSE3";
+        default:
+          return "scalar";
+      }
+    }
+
+    void swapRedBlue(const uint8_t *source, uint8_t *target, size_t count) {
+      auto function = swapFunction.load(memory_order_relaxed);
+      if (!function) {
+        setKernel(Kernel::Automatic);
+        function = swapFunction.load();
+      }
+      function(source, target, count);
+    }
+
+    void bgraToRGB(const uint8_t *source, uint8_t *target, size_t count) {
+      auto function = bgraFunction.load(memory_order_relaxed);
+      if (!function) {
+        setKernel(Kernel::Automatic);
+        function = bgraFunction.load();
+      }
+      function(source, target, count);
+    }
+
+    void fill(uint8_t *target, const uint8_t *color, size_t count) {
+      auto function = fillFunction.load(memory_order_relaxed);
+      if (!function) {
+        setKernel(Kernel::Automatic);
+        function = fillFunction.load();
+      }
+      function(target, color, count);
+    }
+
+    void fill(float *target, float value, size_t count) {
+      auto function = fillFloatFunction.load(memory_order_relaxed);
+      if (!function) {
+        setKernel(Kernel::Automatic);
+        function = fillFloatFunction.load();
+      }
+      function(target, value, count);
+    }
+
+    void copyRows(const uint8_t *source, ptrdiff_t sourceStride, uint8_t *target, ptrdiff_t targetStride,
+                  size_t width, size_t height, bool swap) {
+      for (size_t y = 0; y < height; ++y) {
+        auto sourceRow = source + (ptrdiff_t) y * sourceStride;
+        auto targetRow = target + (ptrdiff_t) y * targetStride;
+        if (swap) {
+          swapRedBlue(sourceRow, targetRow, width);
+        } else if (sourceRow != targetRow) {
+          memmove(targetRow, sourceRow, width * 3);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace ppgso {
+  namespace pixel {
+
+    /*!
+     * Implementations of the pixel conversions
+     */
+    enum class Kernel {
+      Automatic,  // Best kernel supported by the CPU
+      Scalar,     // One pixel at a time
+      SSSE3,      // 5 pixels per byte shuffle
+      AVX2        // 10 pixels per byte shuffle
+    };
+
+    /*!
+     * Select the kernel used by all conversions, kernels not supported by the CPU fall back to the best supported one.
+     * The best kernel is selected automatically, this is only needed to compare the kernels.
+     *
+     * @param kernel - Kernel to use.
+     */
+    void setKernel(Kernel kernel);
+
+    /*!
+     * Get name of the kernel in use.
+     *
+     * @return - Kernel name.
+     */
+    std::string getKernelName();
+
+    /*!
+     * Swap the first and the third channel of 24 bit pixels, converts BGR pixels to RGB and back.
+     *
+     * @param source - Pixels to convert.
+     * @param target - Converted pixels, may be the same as source.
+     * @param count - Number of pixels.
+     */
+    void swapRedBlue(const uint8_t *source, uint8_t *target, size_t count);
+
+    /*!
+     * Convert 32 bit BGRA or BGRX pixels to 24 bit RGB pixels, the fourth channel is dropped.
+     *
+     * @param source - Pixels to convert.
+     * @param target - Converted pixels, must not overlap the source.
+     * @param count - Number of pixels.
+     */
+    void bgraToRGB(const uint8_t *source, uint8_t *target, size_t count);
+
+    /*!
+     * Fill 24 bit pixels with a single color.
+     *
+     * @param target - Pixels to fill.
+     * @param color - Three bytes of the color in the order they are stored.
+     * @param count - Number of pixels.
+     */
+    void fill(uint8_t *target, const uint8_t *color, size_t count);
+
+    /*!
+     * Fill a float buffer with a single value, used for depth buffers and float images.
+     *
+     * @param target - Values to fill.
+     * @param value - Value to store.
+     * @param count - Number of values.
+     */
+    void fill(float *target, float value, size_t count);
+
+    /*!
+     * Copy rows of 24 bit pixels between buffers with different strides. A negative stride of one of the buffers
+     * flips the image vertically, set swap to convert between BGR and RGB at the same time.
+     *
+     * @param source - First row of the source.
+     * @param sourceStride - Distance between the starts of two successive source rows in bytes.
+     * @param target - First row of the target.
+     * @param targetStride - Distance between the starts of two successive target rows in bytes.
+     * @param width - Number of pixels in a row.
+     * @param height - Number of rows.
+     * @param swap - Swap the first and the third channel.
+     */
+    void copyRows(const uint8_t *source, std::ptrdiff_t sourceStride, uint8_t *target, std::ptrdiff_t targetStride,
+                  size_t width, size_t height, bool swap);
+  }
+}
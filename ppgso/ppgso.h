@@ -8,6 +8,28 @@
 #include "image.h"
 #include "image_bmp.h"
 #include "image_raw.h"
+#include "mapped_file.h"
+#include "mapped_image.h"
+#include "pixel_convert.h"
+#include "image_hdr.h"
+#include "image_pool.h"
+#include "tiled_image.h"
+#include "fft.h"
+#include "convolution.h"
+#include "image_pfm.h"
+#include "tonemap.h"
+#include "image_writer.h"
+#include "image_pipeline.h"
+#include "bvh.h"
+#include "thread_pool.h"
+#include "bounded_queue.h"
+#include "tile_scheduler.h"
+#include "cpu.h"
+#include "sphere_set.h"
+#include "accumulation_buffer.h"
+#include "random.h"
+#include "sampler.h"
+#include "triangle_set.h"
 #include "texture.h"
 #include "window.h"
 
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Small and fast PCG32 random number generator (pcg-random.org).
+   *
+   * Unlike glm::linearRand, which relies on the shared std::rand state, each generator owns its 16 byte state.
+   * Samplers seed generators from hashed pixel coordinates so the result does not depend on
+   * the number of threads or the order in which pixels are processed.
+   */
+  class Random {
+  public:
+    /*!
+     * Create a generator.
+     *
+     * @param seed - Initial state.
+     * @param stream - Selects one of 2^63 independent sequences.
+     */
+    explicit Random(uint64_t seed = 0x853c49e6748fea9bull, uint64_t stream = 0xda3e39cb94b95bdbull) {
+      state = 0;
+      increment = (stream << 1u) | 1u;
+      next();
+      state += seed;
+      next();
+    }
+
+    /*!
+     * Scramble bits of a 64 bit value (SplitMix64 finalizer).
+     *
+     * @param value - Value to hash.
+     * @return - Hashed value.
+     */
+    static uint64_t hash(uint64_t value) {
+      value += 0x9e3779b97f4a7c15ull;
+      value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+      value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+      return value ^ (value >> 31);
+    }
+
+    /*!
+     * Generate next 32 random bits.
+     *
+     * @return - Uniformly distributed 32 bit value.
+     */
+    uint32_t next() {
+      uint64_t old = state;
+      state = old * 6364136223846793005ull + increment;
+      auto shifted = (uint32_t) (((old >> 18u) ^ old) >> 27u);
+      auto rotation = (uint32_t) (old >> 59u);
+      return (shifted >> rotation) | (shifted << ((-rotation) & 31u));
+    }
+
+    /*!
+     * Generate a float in the <0, 1) range.
+     *
+     * @return - Uniformly distributed float.
+     */
+    float nextFloat() {
+      return (float) (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /*!
+     * Generate a double in the <0, 1) range.
+     *
+     * @return - Uniformly distributed double.
+     */
+    double nextDouble() {
+      uint64_t high = next();
+      uint64_t low = next();
+      return (double) ((high << 21) ^ (low >> 11)) * (1.0 / 9007199254740992.0);
+    }
+
+    /*!
+     * Generate a double in the <min, max) range.
+     *
+     * @param min - Lower bound.
+     * @param max - Upper bound.
+     * @return - Uniformly distributed double.
+     */
+    double uniform(double min, double max) {
+      return min + (max - min) * nextDouble();
+    }
+
+  private:
+    uint64_t state;
+    uint64_t increment;
+  };
+
+  /*!
+   * Map two uniform numbers to a direction on a hemisphere with density proportional to the cosine
+   * of the angle to the normal, this matches the distribution of light reflected by diffuse surfaces.
+   *
+   * @param normal - Normalized vector pointing to the center of the hemisphere.
+   * @param u - Two uniform numbers in the <0, 1) range.
+   * @return - Normalized direction.
+   */
+  inline glm::dvec3 cosineHemisphere(const glm::dvec3 &normal, const glm::dvec2 &u) {
+    // Orthonormal basis around the normal (Duff et al. 2017)
+    double sign = normal.z >= 0 ? 1.0 : -1.0;
+    double a = -1.0 / (sign + normal.z);
+    double b = normal.x * normal.y * a;
+    glm::dvec3 tangent{1.0 + sign * normal.x * normal.x * a, sign * b, -sign * normal.x};
+    glm::dvec3 bitangent{b, sign + normal.y * normal.y * a, -normal.y};
+
+    // Uniform point on a disc projected up to the hemisphere
+    double radius = glm::sqrt(u.x);
+    double phi = 2.0 * glm::pi<double>() * u.y;
+    double z = glm::sqrt(glm::max(0.0, 1.0 - u.x));
+    return tangent * (radius * glm::cos(phi)) + bitangent * (radius * glm::sin(phi)) + normal * z;
+  }
+}
@@ -0,0 +1,322 @@
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#include "sampler.h"
+#include "random.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+// Size of the blue noise texture, must be a power of two
+static const int BLUE_NOISE_SIZE = 64;
+
+// Convert 32 bits to a double in the <0, 1) range
+static double toUnit(uint32_t bits) {
+  return bits * (1.0 / 4294967296.0);
+}
+
+// Convert 64 bits to a double in the <0, 1) range
+static double toUnit(uint64_t bits) {
+  return (double) (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Seed unique for a pixel and dimension
+static uint64_t hashPixel(uint64_t seed, uint32_t x, uint32_t y, uint32_t dimension) {
+  return Random::hash(Random::hash(seed ^ Random::hash(((uint64_t) y << 32) | x)) + dimension);
+}
+
+// Random permutation of <0, length) without storing it (Kensler 2013, Correlated Multi-Jittered Sampling)
+static uint32_t permute(uint32_t i, uint32_t length, uint32_t p) {
+  uint32_t w = length - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  do {
+    i ^= p;
+    i *= 0xe170893d;
+    i ^= p >> 16;
+    i ^= (i & w) >> 4;
+    i ^= p >> 8;
+    i *= 0x0929eb3f;
+    i ^= p >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | p >> 27;
+    i *= 0x6935fa69;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3df;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= length);
+  return (i + p) % length;
+}
+
+static uint32_t reverseBits(uint32_t value) {
+  value = (value << 16) | (value >> 16);
+  value = ((value & 0x00ff00ff) << 8) | ((value & 0xff00ff00) >> 8);
+  value = ((value & 0x0f0f0f0f) << 4) | ((value & 0xf0f0f0f0) >> 4);
+  value = ((value & 0x33333333) << 2) | ((value & 0xcccccccc) >> 2);
+  value = ((value & 0x55555555) << 1) | ((value & 0xaaaaaaaa) >> 1);
+  return value;
+}
+
+// Owen scrambling of a binary fraction, each bit is flipped depending only on the bits above it
+static uint32_t owenScramble(uint32_t value, uint32_t seed) {
+  value = reverseBits(value);
+  value += seed;
+  value ^= value * 0x6c50b47cu;
+  value ^= value * 0xb82f1e52u;
+  value ^= value * 0xc7afe638u;
+  value ^= value * 0x8d22f6e6u;
+  return reverseBits(value);
+}
+
+// First two dimensions of the Sobol sequence as binary fractions
+static uint32_t sobol0(uint32_t index) {
+  return reverseBits(index);
+}
+
+static uint32_t sobol1(uint32_t index) {
+  uint32_t result = 0;
+  for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+    if (index & 1) result ^= v;
+  return result;
+}
+
+// Blue noise threshold map generated by the void and cluster method (Ulichney 1993)
+static vector<float> generateBlueNoise(int size) {
+  const double sigma = 1.5;
+  auto count = size * size;
+  auto mask = size - 1;
+
+  // Toroidal gaussian energy filter
+  vector<double> kernel((size_t) count);
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      int dx = std::min(x, size - x), dy = std::min(y, size - y);
+      kernel[x + y * size] = exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+    }
+  }
+
+  vector<char> pattern((size_t) count);
+  vector<double> energy((size_t) count);
+  auto splat = [&](int index, double sign) {
+    int px = index % size, py = index / size;
+    for (int y = 0; y < size; ++y)
+      for (int x = 0; x < size; ++x)
+        energy[x + y * size] += sign * kernel[((x - px) & mask) + ((y - py) & mask) * size];
+  };
+  auto tightestCluster = [&] {
+    int result = -1;
+    for (int i = 0; i < count; ++i)
+      if (pattern[i] && (result < 0 || energy[i] > energy[result])) result = i;
+    return result;
+  };
+  auto largestVoid = [&] {
+    int result = -1;
+    for (int i = 0; i < count; ++i)
+      if (!pattern[i] && (result < 0 || energy[i] < energy[result])) result = i;
+    return result;
+  };
+
+  // Random initial pattern with a tenth of the pixels set
+  Random random{0x626c75656e6f6973ull};
+  int ones = 0;
+  while (ones < count / 10) {
+    auto index = (int) (random.next() % (uint32_t) count);
+    if (pattern[index]) continue;
+    pattern[index] = 1;
+    splat(index, 1);
+    ones++;
+  }
+
+  // Spread the initial pattern evenly by moving pixels from clusters to voids
+  for (;;) {
+    auto cluster = tightestCluster();
+    pattern[cluster] = 0;
+    splat(cluster, -1);
+    auto hole = largestVoid();
+    pattern[hole] = 1;
+    splat(hole, 1);
+    if (hole == cluster) break;
+  }
+  auto initialPattern = pattern;
+  auto initialEnergy = energy;
+
+  // Rank the initial pixels by removing tightest clusters first
+  vector<int> rank((size_t) count);
+  for (int r = ones - 1; r >= 0; --r) {
+    auto cluster = tightestCluster();
+    pattern[cluster] = 0;
+    splat(cluster, -1);
+    rank[cluster] = r;
+  }
+
+  // Rank the remaining pixels by filling the largest voids
+  pattern = initialPattern;
+  energy = initialEnergy;
+  for (int r = ones; r < count; ++r) {
+    auto hole = largestVoid();
+    pattern[hole] = 1;
+    splat(hole, 1);
+    rank[hole] = r;
+  }
+
+  vector<float> result((size_t) count);
+  for (int i = 0; i < count; ++i)
+    result[i] = (rank[i] + 0.5f) / count;
+  return result;
+}
+
+static const vector<float> &blueNoiseTexture() {
+  static const vector<float> texture = generateBlueNoise(BLUE_NOISE_SIZE);
+  return texture;
+}
+
+unique_ptr<Sampler> Sampler::create(const string &name, uint32_t samplesPerPixel, uint64_t seed) {
+  if (name == "random") return unique_ptr<Sampler>(new RandomSampler{seed});
+  if (name == "stratified") return unique_ptr<Sampler>(new StratifiedSampler{samplesPerPixel, seed});
+  if (name == "halton") return unique_ptr<Sampler>(new HaltonSampler{seed});
+  if (name == "sobol") return unique_ptr<Sampler>(new SobolSampler{seed});
+  if (name == "bluenoise") return unique_ptr<Sampler>(new BlueNoiseSampler{seed});
+
+  stringstream msg;
+  msg << "Unknown sampler " << name << ", use random, stratified, halton, sobol or bluenoise.";
+  throw runtime_error(msg.str());
+}
+
+bool Sampler::isKnown(const string &name) {
+  return name == "random" || name == "stratified" || name == "halton" || name == "sobol" || name == "bluenoise";
+}
+
+RandomSampler::RandomSampler(uint64_t seed) : seed{seed} {}
+
+double RandomSampler::get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  return toUnit(Random::hash(hashPixel(seed, x, y, dimension) + index));
+}
+
+dvec2 RandomSampler::get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  return {get1D(x, y, index, dimension), get1D(x, y, index, dimension + 1)};
+}
+
+StratifiedSampler::StratifiedSampler(uint32_t samplesPerPixel, uint64_t seed) : seed{seed} {
+  samples = std::max(1u, samplesPerPixel);
+  resolution = (uint32_t) sqrt((double) samples);
+}
+
+double StratifiedSampler::get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  auto pixel = hashPixel(seed, x, y, dimension);
+  auto jitter = toUnit(Random::hash(pixel + index));
+  if (index >= samples) return jitter;
+
+  auto stratum = permute(index, samples, (uint32_t) pixel);
+  return (stratum + jitter) / samples;
+}
+
+dvec2 StratifiedSampler::get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  auto pixel = hashPixel(seed, x, y, dimension);
+  Random random{Random::hash(pixel + index), pixel};
+  dvec2 jitter{random.nextDouble(), random.nextDouble()};
+  auto strata = resolution * resolution;
+  if (index >= strata) return jitter;
+
+  auto stratum = permute(index, strata, (uint32_t) pixel);
+  return (dvec2{stratum % resolution, stratum / resolution} + jitter) / (double) resolution;
+}
+
+HaltonSampler::HaltonSampler(uint64_t seed, uint32_t dimensions) : seed{seed} {
+  // Each dimension uses the next prime as base
+  for (uint32_t candidate = 2; primes.size() < dimensions; ++candidate) {
+    bool prime = true;
+    for (auto p : primes) {
+      if (p * p > candidate) break;
+      if (candidate % p == 0) {
+        prime = false;
+        break;
+      }
+    }
+    if (prime) primes.push_back(candidate);
+  }
+
+  permutations.resize(dimensions);
+  for (uint32_t dimension = 0; dimension < dimensions; ++dimension) {
+    auto base = primes[dimension];
+    auto p = (uint32_t) Random::hash(seed + dimension);
+    permutations[dimension].resize(base);
+    for (uint32_t digit = 0; digit < base; ++digit)
+      permutations[dimension][digit] = (uint16_t) permute(digit, base, p);
+  }
+}
+
+double HaltonSampler::radicalInverse(uint32_t dimension, uint32_t index) const {
+  // Higher dimensions than prepared reuse the prepared bases
+  dimension %= (uint32_t) primes.size();
+  auto base = primes[dimension];
+  auto &permutation = permutations[dimension];
+
+  // Permuted digits are summed in reverse order, the leading zeros continue until double precision runs out
+  double invBase = 1.0 / base, scale = invBase, result = 0;
+  while (scale * base > numeric_limits<double>::epsilon()) {
+    result += permutation[index % base] * scale;
+    index /= base;
+    scale *= invBase;
+  }
+  return std::min(result, 1.0 - numeric_limits<double>::epsilon() / 2);
+}
+
+double HaltonSampler::get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  auto shift = toUnit(hashPixel(seed, x, y, dimension));
+  return fract(radicalInverse(dimension, index) + shift);
+}
+
+dvec2 HaltonSampler::get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  return {get1D(x, y, index, dimension), get1D(x, y, index, dimension + 1)};
+}
+
+SobolSampler::SobolSampler(uint64_t seed) : seed{seed} {}
+
+double SobolSampler::get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  auto pixel = hashPixel(seed, x, y, dimension);
+  auto shuffled = owenScramble(index, (uint32_t) pixel);
+  return toUnit(owenScramble(sobol0(shuffled), (uint32_t) (pixel >> 32)));
+}
+
+dvec2 SobolSampler::get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  // Both dimensions share the shuffled index so they stay stratified together
+  auto pixel = hashPixel(seed, x, y, dimension);
+  auto shuffled = owenScramble(index, (uint32_t) pixel);
+  auto scramble = Random::hash(pixel);
+  return {toUnit(owenScramble(sobol0(shuffled), (uint32_t) scramble)),
+          toUnit(owenScramble(sobol1(shuffled), (uint32_t) (scramble >> 32)))};
+}
+
+BlueNoiseSampler::BlueNoiseSampler(uint64_t seed) : seed{seed}, texture{blueNoiseTexture()} {}
+
+double BlueNoiseSampler::offset(uint32_t x, uint32_t y, uint32_t dimension) const {
+  // Each dimension reads the texture at a different toroidal shift so the dimensions are not correlated
+  auto shift = Random::hash(seed + dimension);
+  auto tx = (x + (uint32_t) shift) & (BLUE_NOISE_SIZE - 1);
+  auto ty = (y + (uint32_t) (shift >> 32)) & (BLUE_NOISE_SIZE - 1);
+  return texture[tx + ty * BLUE_NOISE_SIZE];
+}
+
+double BlueNoiseSampler::get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  // Golden ratio sequence rotated by the blue noise value of the pixel
+  const double alpha = 0.6180339887498949;
+  return fract(0.5 + alpha * index + offset(x, y, dimension));
+}
+
+dvec2 BlueNoiseSampler::get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+  // R2 sequence (Roberts 2018) rotated by the blue noise value of the pixel
+  const dvec2 alpha{0.7548776662466927, 0.5698402909980532};
+  auto value = dvec2{0.5} + alpha * (double) index;
+  return fract(value + dvec2{offset(x, y, dimension), offset(x, y, dimension + 1)});
+}
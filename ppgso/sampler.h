@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Source of sample values for Monte Carlo rendering.
+   *
+   * A sample is identified by its pixel, its index within the pixel and a dimension, each random decision
+   * of a rendered path uses its own dimension. Samplers are stateless so a single instance can be shared by all
+   * threads and the result does not depend on the order in which samples are generated.
+   * Use SampleStream to hand out dimensions to a renderer one after another.
+   */
+  class Sampler {
+  public:
+    virtual ~Sampler() = default;
+
+    /*!
+     * Get a single sample value.
+     *
+     * @param x - Horizontal position of the pixel.
+     * @param y - Vertical position of the pixel.
+     * @param index - Index of the sample within the pixel.
+     * @param dimension - Dimension of the sample.
+     * @return - Value in the <0, 1) range.
+     */
+    virtual double get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const = 0;
+
+    /*!
+     * Get a pair of sample values that are well distributed together, such as an image position or a direction.
+     *
+     * @param x - Horizontal position of the pixel.
+     * @param y - Vertical position of the pixel.
+     * @param index - Index of the sample within the pixel.
+     * @param dimension - First of the two dimensions used.
+     * @return - Values in the <0, 1) range.
+     */
+    virtual glm::dvec2 get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const = 0;
+
+    /*!
+     * Create a sampler by name.
+     *
+     * @param name - One of "random", "stratified", "halton", "sobol" or "bluenoise".
+     * @param samplesPerPixel - Expected number of samples per pixel, used by the stratified sampler.
+     * @param seed - Seed to decorrelate different renders.
+     * @return - New sampler.
+     */
+    static std::unique_ptr<Sampler> create(const std::string &name, uint32_t samplesPerPixel, uint64_t seed = 0);
+
+    /*!
+     * Check whether a sampler name is accepted by create, so command line options can be validated when parsed.
+     *
+     * @param name - Name of the sampler.
+     * @return - True for "random", "stratified", "halton", "sobol" and "bluenoise".
+     */
+    static bool isKnown(const std::string &name);
+  };
+
+  /*!
+   * Independent uniform random samples, the reference all other samplers are compared against.
+   */
+  class RandomSampler : public Sampler {
+  public:
+    explicit RandomSampler(uint64_t seed = 0);
+    double get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+    glm::dvec2 get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+  private:
+    uint64_t seed;
+  };
+
+  /*!
+   * Jittered stratification, every sample of a pixel falls into its own stratum.
+   * Strata are shuffled differently for each pixel and dimension, samples beyond the expected count are random.
+   */
+  class StratifiedSampler : public Sampler {
+  public:
+    StratifiedSampler(uint32_t samplesPerPixel, uint64_t seed = 0);
+    double get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+    glm::dvec2 get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+  private:
+    uint32_t samples, resolution;
+    uint64_t seed;
+  };
+
+  /*!
+   * Halton sequence with random digit permutations for each dimension,
+   * pixels are decorrelated using a random toroidal shift.
+   */
+  class HaltonSampler : public Sampler {
+  public:
+    explicit HaltonSampler(uint64_t seed = 0, uint32_t dimensions = 512);
+    double get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+    glm::dvec2 get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+  private:
+    uint64_t seed;
+    std::vector<uint32_t> primes;
+    std::vector<std::vector<uint16_t>> permutations;
+    double radicalInverse(uint32_t dimension, uint32_t index) const;
+  };
+
+  /*!
+   * Owen scrambled Sobol sequence (Burley 2020, Practical Hash-based Owen Scrambling).
+   * Dimensions are used in pairs of the first two Sobol dimensions, each pair has its own scrambling
+   * and its own shuffled sample order so the pairs stay uncorrelated.
+   */
+  class SobolSampler : public Sampler {
+  public:
+    explicit SobolSampler(uint64_t seed = 0);
+    double get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+    glm::dvec2 get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+  private:
+    uint64_t seed;
+  };
+
+  /*!
+   * Low discrepancy sequence shared by all pixels and rotated by a blue noise texture per pixel
+   * (Georgiev and Fajardo 2016). Errors of neighbouring pixels differ as much as possible, so the remaining noise
+   * is high frequency and less visible at low sample counts.
+   */
+  class BlueNoiseSampler : public Sampler {
+  public:
+    explicit BlueNoiseSampler(uint64_t seed = 0);
+    double get1D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+    glm::dvec2 get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const override;
+  private:
+    uint64_t seed;
+    const std::vector<float> &texture;
+    double offset(uint32_t x, uint32_t y, uint32_t dimension) const;
+  };
+
+  /*!
+   * Hands out consecutive sample dimensions of a single pixel sample to a renderer
+   */
+  class SampleStream {
+  public:
+    /*!
+     * Start a pixel sample.
+     *
+     * @param sampler - Sampler to take values from.
+     * @param x - Horizontal position of the pixel.
+     * @param y - Vertical position of the pixel.
+     * @param index - Index of the sample within the pixel.
+     */
+    SampleStream(const Sampler &sampler, uint32_t x, uint32_t y, uint32_t index)
+        : sampler{sampler}, x{x}, y{y}, index{index} {}
+
+    /*!
+     * Get the value of the next dimension.
+     *
+     * @return - Value in the <0, 1) range.
+     */
+    double get1D() {
+      return sampler.get1D(x, y, index, dimension++);
+    }
+
+    /*!
+     * Get the values of the next two dimensions.
+     *
+     * @return - Values in the <0, 1) range.
+     */
+    glm::dvec2 get2D() {
+      auto result = sampler.get2D(x, y, index, dimension);
+      dimension += 2;
+      return result;
+    }
+
+  private:
+    const Sampler &sampler;
+    uint32_t x, y, index;
+    uint32_t dimension = 0;
+  };
+}
@@ -0,0 +1,227 @@
+#include <cmath>
+
+#include "cpu.h"
+#include "sphere_set.h"
+
+#ifdef PPGSO_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+// Padding of the coordinate arrays, equals the widest vector minus one lane
+constexpr size_t PADDING = 3;
+
+SphereSet::SphereSet() {
+  clear();
+  setKernel(Kernel::Automatic);
+}
+
+void SphereSet::add(const dvec3 &center, double radius) {
+  centerX.resize(count + 1 + PADDING);
+  centerY.resize(count + 1 + PADDING);
+  centerZ.resize(count + 1 + PADDING);
+  radius2.resize(count + 1 + PADDING);
+  centerX[count] = center.x;
+  centerY[count] = center.y;
+  centerZ[count] = center.z;
+  radius2[count] = radius * radius;
+  ++count;
+}
+
+void SphereSet::clear() {
+  count = 0;
+  centerX.assign(PADDING, 0);
+  centerY.assign(PADDING, 0);
+  centerZ.assign(PADDING, 0);
+  radius2.assign(PADDING, 0);
+}
+
+size_t SphereSet::size() const {
+  return count;
+}
+
+void SphereSet::setKernel(Kernel kernel) {
+  if (kernel == Kernel::AVX2 && !cpu::hasAVX2()) kernel = Kernel::Automatic;
+  if (kernel == Kernel::SSE2 && !cpu::hasSSE2()) kernel = Kernel::Automatic;
+  if (kernel == Kernel::Automatic)
+    kernel = cpu::hasAVX2() ? Kernel::AVX2 : cpu::hasSSE2() ? Kernel::SSE2 : Kernel::Scalar;
+
+  this->kernel = kernel;
+  switch (kernel) {
+    case Kernel::AVX2:
+      function = intersectAVX2;
+      break;
+    case Kernel::SSE2:
+      function = intersectSSE2;
+      break;
+    default:
+      function = intersectScalar;
+      break;
+  }
+}
+
+string SphereSet::getKernelName() const {
+  switch (kernel) {
+    case Kernel::AVX2:
+      return "AVX2";
+    case Kernel::SSE2:
+      return "SSE2";
+    default:
+      return "scalar";
+  }
+}
+
+int SphereSet::intersectScalar(const SphereSet &set, const dvec3 &origin, const dvec3 &direction,
+                               size_t first, size_t count, double tMin, double &tMax) {
+  double a = dot(direction, direction);
+  int best = -1;
+  for (size_t i = first; i < first + count; ++i) {
+    dvec3 oc = origin - dvec3{set.centerX[i], set.centerY[i], set.centerZ[i]};
+    double b = dot(oc, direction);
+    double c = dot(oc, oc) - set.radius2[i];
+    double dis = b * b - a * c;
+    if (dis > 0) {
+      double e = sqrt(dis);
+      double t = (-b - e) / a;
+      if (!(t > tMin)) t = (-b + e) / a;
+      if (t > tMin && t < tMax) {
+        tMax = t;
+        best = (int) i;
+      }
+    }
+  }
+  return best;
+}
+
+#ifdef PPGSO_X86
+
+/*!
+ * Pick the closest hit from per lane results, ties are resolved in favour of the lower index
+ * to match the order of the scalar kernel
+ */
+static int reduceLanes(const double *distance, const double *index, int lanes, double &tMax) {
+  int best = -1;
+  double bestDistance = tMax;
+  for (int lane = 0; lane < lanes; ++lane) {
+    if (index[lane] < 0) continue;
+    if (best < 0 || distance[lane] < bestDistance || (distance[lane] == bestDistance && index[lane] < best)) {
+      best = (int) index[lane];
+      bestDistance = distance[lane];
+    }
+  }
+  if (best >= 0) tMax = bestDistance;
+  return best;
+}
+
+int SphereSet::intersectSSE2(const SphereSet &set, const dvec3 &origin, const dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax) {
+  const __m128d ox = _mm_set1_pd(origin.x), oy = _mm_set1_pd(origin.y), oz = _mm_set1_pd(origin.z);
+  const __m128d dx = _mm_set1_pd(direction.x), dy = _mm_set1_pd(direction.y), dz = _mm_set1_pd(direction.z);
+  const __m128d a = _mm_set1_pd(dot(direction, direction));
+  const __m128d zero = _mm_setzero_pd(), sign = _mm_set1_pd(-0.0), step = _mm_set1_pd(2.0);
+  const __m128d lower = _mm_set1_pd(tMin), end = _mm_set1_pd((double) (first + count));
+
+  __m128d bestDistance = _mm_set1_pd(tMax);
+  __m128d bestIndex = _mm_set1_pd(-1.0);
+  __m128d index = _mm_set_pd((double) first + 1, (double) first);
+
+  for (size_t i = first; i < first + count; i += 2) {
+    __m128d ocx = _mm_sub_pd(ox, _mm_loadu_pd(&set.centerX[i]));
+    __m128d ocy = _mm_sub_pd(oy, _mm_loadu_pd(&set.centerY[i]));
+    __m128d ocz = _mm_sub_pd(oz, _mm_loadu_pd(&set.centerZ[i]));
+    __m128d b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, dx), _mm_mul_pd(ocy, dy)), _mm_mul_pd(ocz, dz));
+    __m128d c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz)),
+                           _mm_loadu_pd(&set.radius2[i]));
+    __m128d dis = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(a, c));
+    __m128d mask = _mm_and_pd(_mm_cmpgt_pd(dis, zero), _mm_cmplt_pd(index, end));
+
+    // Most spheres are missed, skip the square root and divisions
+    if (_mm_movemask_pd(mask) == 0) {
+      index = _mm_add_pd(index, step);
+      continue;
+    }
+
+    __m128d e = _mm_sqrt_pd(dis);
+    __m128d negB = _mm_xor_pd(b, sign);
+    __m128d t1 = _mm_div_pd(_mm_sub_pd(negB, e), a);
+    __m128d t2 = _mm_div_pd(_mm_add_pd(negB, e), a);
+    __m128d front = _mm_cmpgt_pd(t1, lower);
+    __m128d t = _mm_or_pd(_mm_and_pd(front, t1), _mm_andnot_pd(front, t2));
+
+    __m128d valid = _mm_and_pd(mask, _mm_and_pd(_mm_cmpgt_pd(t, lower), _mm_cmplt_pd(t, bestDistance)));
+    bestDistance = _mm_or_pd(_mm_and_pd(valid, t), _mm_andnot_pd(valid, bestDistance));
+    bestIndex = _mm_or_pd(_mm_and_pd(valid, index), _mm_andnot_pd(valid, bestIndex));
+    index = _mm_add_pd(index, step);
+  }
+
+  double distances[2], indices[2];
+  _mm_storeu_pd(distances, bestDistance);
+  _mm_storeu_pd(indices, bestIndex);
+  return reduceLanes(distances, indices, 2, tMax);
+}
+
+PPGSO_TARGET("avx2")
+int SphereSet::intersectAVX2(const SphereSet &set, const dvec3 &origin, const dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax) {
+  const __m256d ox = _mm256_set1_pd(origin.x), oy = _mm256_set1_pd(origin.y), oz = _mm256_set1_pd(origin.z);
+  const __m256d dx = _mm256_set1_pd(direction.x), dy = _mm256_set1_pd(direction.y), dz = _mm256_set1_pd(direction.z);
+  const __m256d a = _mm256_set1_pd(dot(direction, direction));
+  const __m256d zero = _mm256_setzero_pd(), sign = _mm256_set1_pd(-0.0), step = _mm256_set1_pd(4.0);
+  const __m256d lower = _mm256_set1_pd(tMin), end = _mm256_set1_pd((double) (first + count));
+
+  __m256d bestDistance = _mm256_set1_pd(tMax);
+  __m256d bestIndex = _mm256_set1_pd(-1.0);
+  __m256d index = _mm256_set_pd((double) first + 3, (double) first + 2, (double) first + 1, (double) first);
+
+  for (size_t i = first; i < first + count; i += 4) {
+    __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(&set.centerX[i]));
+    __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(&set.centerY[i]));
+    __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(&set.centerZ[i]));
+    __m256d b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+    __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)),
+                                            _mm256_mul_pd(ocz, ocz)),
+                              _mm256_loadu_pd(&set.radius2[i]));
+    __m256d dis = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(a, c));
+    __m256d mask = _mm256_and_pd(_mm256_cmp_pd(dis, zero, _CMP_GT_OQ), _mm256_cmp_pd(index, end, _CMP_LT_OQ));
+
+    // Most spheres are missed, skip the square root and divisions
+    if (_mm256_movemask_pd(mask) == 0) {
+      index = _mm256_add_pd(index, step);
+      continue;
+    }
+
+    __m256d e = _mm256_sqrt_pd(dis);
+    __m256d negB = _mm256_xor_pd(b, sign);
+    __m256d t1 = _mm256_div_pd(_mm256_sub_pd(negB, e), a);
+    __m256d t2 = _mm256_div_pd(_mm256_add_pd(negB, e), a);
+    __m256d t = _mm256_blendv_pd(t2, t1, _mm256_cmp_pd(t1, lower, _CMP_GT_OQ));
+
+    __m256d valid = _mm256_and_pd(mask, _mm256_and_pd(_mm256_cmp_pd(t, lower, _CMP_GT_OQ),
+                                                      _mm256_cmp_pd(t, bestDistance, _CMP_LT_OQ)));
+    bestDistance = _mm256_blendv_pd(bestDistance, t, valid);
+    bestIndex = _mm256_blendv_pd(bestIndex, index, valid);
+    index = _mm256_add_pd(index, step);
+  }
+
+  double distances[4], indices[4];
+  _mm256_storeu_pd(distances, bestDistance);
+  _mm256_storeu_pd(indices, bestIndex);
+  return reduceLanes(distances, indices, 4, tMax);
+}
+
+#else
+
+int SphereSet::intersectSSE2(const SphereSet &set, const dvec3 &origin, const dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax) {
+  return intersectScalar(set, origin, direction, first, count, tMin, tMax);
+}
+
+int SphereSet::intersectAVX2(const SphereSet &set, const dvec3 &origin, const dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax) {
+  return intersectScalar(set, origin, direction, first, count, tMin, tMax);
+}
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <string>
+
+#include <glm/glm.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Structure of arrays storage for sphere geometry with SIMD ray intersection kernels.
+   *
+   * One ray is tested against 2 (SSE2) or 4 (AVX2) spheres per instruction. The kernel is chosen at runtime
+   * depending on the CPU, all kernels follow the same sequence of floating point operations as a scalar
+   * ray to sphere test so results do not depend on the kernel used.
+   */
+  class SphereSet {
+  public:
+    enum class Kernel {
+      Automatic, Scalar, SSE2, AVX2
+    };
+
+    /*!
+     * Create empty set using the best kernel supported by the CPU.
+     */
+    SphereSet();
+
+    /*!
+     * Add a sphere to the end of the set.
+     *
+     * @param center - Center of the sphere.
+     * @param radius - Radius of the sphere.
+     */
+    void add(const glm::dvec3 &center, double radius);
+
+    /*!
+     * Remove all spheres.
+     */
+    void clear();
+
+    /*!
+     * Get number of spheres in the set.
+     *
+     * @return - Number of spheres.
+     */
+    size_t size() const;
+
+    /*!
+     * Select the intersection kernel, kernels not supported by the CPU fall back to the best supported one.
+     *
+     * @param kernel - Kernel to use.
+     */
+    void setKernel(Kernel kernel);
+
+    /*!
+     * Get name of the kernel in use.
+     *
+     * @return - Kernel name.
+     */
+    std::string getKernelName() const;
+
+    /*!
+     * Find the closest sphere hit by a ray in a continuous range of spheres.
+     *
+     * @param origin - Ray origin.
+     * @param direction - Ray direction, does not need to be normalized.
+     * @param first - Index of first sphere to test.
+     * @param count - Number of spheres to test.
+     * @param tMin - Hits at or below this distance are ignored.
+     * @param tMax - Only hits closer than tMax are reported, updated to the distance of the reported hit.
+     * @return - Index of the closest sphere hit or -1 if there is no closer hit.
+     */
+    int intersect(const glm::dvec3 &origin, const glm::dvec3 &direction, size_t first, size_t count,
+                  double tMin, double &tMax) const {
+      return function(*this, origin, direction, first, count, tMin, tMax);
+    }
+
+  private:
+    using Function = int (*)(const SphereSet &set, const glm::dvec3 &origin, const glm::dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax);
+
+    // Arrays are padded so vector loads past the last sphere stay in bounds
+    std::vector<double> centerX, centerY, centerZ, radius2;
+    size_t count = 0;
+    Kernel kernel;
+    Function function;
+
+    static int intersectScalar(const SphereSet &set, const glm::dvec3 &origin, const glm::dvec3 &direction,
+                               size_t first, size_t count, double tMin, double &tMax);
+    static int intersectSSE2(const SphereSet &set, const glm::dvec3 &origin, const glm::dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax);
+    static int intersectAVX2(const SphereSet &set, const glm::dvec3 &origin, const glm::dvec3 &direction,
+                             size_t first, size_t count, double tMin, double &tMax);
+  };
+}
@@ -0,0 +1,116 @@
+#include "thread_pool.h"
+
+using namespace std;
+using namespace ppgso;
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  if (threads == 0) threads = thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+
+  for (unsigned int i = 0; i < threads; ++i)
+    queues.emplace_back(new Queue);
+
+  // The calling thread acts as thread 0
+  for (unsigned int i = 1; i < threads; ++i)
+    workers.emplace_back(&ThreadPool::worker, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  started.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+unsigned int ThreadPool::getThreadCount() const {
+  return (unsigned int) queues.size();
+}
+
+void ThreadPool::run(size_t count, const Task &task) {
+  if (count == 0) return;
+
+  // Give each thread a continuous range of items, neighbouring items tend to share data
+  auto threads = queues.size();
+  for (size_t i = 0; i < threads; ++i) {
+    auto &queue = *queues[i];
+    lock_guard<std::mutex> lock(queue.mutex);
+    for (size_t item = i * count / threads; item < (i + 1) * count / threads; ++item)
+      queue.items.push_back(item);
+  }
+
+  {
+    lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    error = nullptr;
+    active = (unsigned int) workers.size();
+    ++generation;
+  }
+  started.notify_all();
+
+  process(0);
+
+  exception_ptr failure;
+  {
+    unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return active == 0; });
+    this->task = nullptr;
+    failure = error;
+  }
+  if (failure) rethrow_exception(failure);
+}
+
+void ThreadPool::worker(unsigned int thread) {
+  size_t seen = 0;
+  while (true) {
+    {
+      unique_lock<std::mutex> lock(mutex);
+      started.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) return;
+      seen = generation;
+    }
+
+    process(thread);
+
+    {
+      lock_guard<std::mutex> lock(mutex);
+      if (--active == 0) finished.notify_all();
+    }
+  }
+}
+
+void ThreadPool::process(unsigned int thread) {
+  size_t item;
+  while (pop(thread, item) || steal(thread, item)) {
+    try {
+      (*task)(item, thread);
+    } catch (...) {
+      lock_guard<std::mutex> lock(mutex);
+      if (!error) error = current_exception();
+    }
+  }
+}
+
+bool ThreadPool::pop(unsigned int thread, size_t &item) {
+  auto &queue = *queues[thread];
+  lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.items.empty()) return false;
+  item = queue.items.front();
+  queue.items.pop_front();
+  return true;
+}
+
+bool ThreadPool::steal(unsigned int thread, size_t &item) {
+  auto threads = (unsigned int) queues.size();
+  for (unsigned int i = 1; i < threads; ++i) {
+    auto &queue = *queues[(thread + i) % threads];
+    lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.items.empty()) continue;
+    item = queue.items.back();
+    queue.items.pop_back();
+    return true;
+  }
+  return false;
+}
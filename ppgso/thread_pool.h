@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace ppgso {
+
+  /*!
+   * Simple work stealing thread pool.
+   *
+   * Work is submitted as a range of indices that is split into per-thread queues.
+   * Each thread processes its own queue from the front and steals from the back of other queues once it runs dry,
+   * so uneven work items do not leave threads idle at the end of a batch.
+   */
+  class ThreadPool {
+  public:
+    /*!
+     * Task callback receiving the work item index and the index of the thread that runs it
+     */
+    using Task = std::function<void(size_t index, unsigned int thread)>;
+
+    /*!
+     * Start the worker threads.
+     *
+     * @param threads - Number of threads including the calling thread, 0 uses all hardware threads.
+     */
+    explicit ThreadPool(unsigned int threads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /*!
+     * Get number of threads used to process work including the calling thread.
+     *
+     * @return - Number of threads.
+     */
+    unsigned int getThreadCount() const;
+
+    /*!
+     * Run a task for every index in <0, count) and wait until all of them finish.
+     * The calling thread takes part in the work. Must not be called from within a running task.
+     * The first exception thrown by a task is rethrown once the batch finishes.
+     *
+     * @param count - Number of work items.
+     * @param task - Task to run for each item.
+     */
+    void run(size_t count, const Task &task);
+
+  private:
+    struct Queue {
+      std::mutex mutex;
+      std::deque<size_t> items;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable started, finished;
+    const Task *task = nullptr;
+    size_t generation = 0;
+    unsigned int active = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    void worker(unsigned int thread);
+    void process(unsigned int thread);
+    bool pop(unsigned int thread, size_t &item);
+    bool steal(unsigned int thread, size_t &item);
+  };
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include "tile_scheduler.h"
+
+using namespace std;
+using namespace ppgso;
+
+TileScheduler::TileScheduler(unsigned int threads, int tileSize) : pool{threads}, tileSize{std::max(1, tileSize)} {}
+
+void TileScheduler::run(int width, int height, const function<void(const Tile &)> &task) {
+  int columns = (width + tileSize - 1) / tileSize;
+  int rows = (height + tileSize - 1) / tileSize;
+
+  timings.resize((size_t) (columns * rows));
+  for (int row = 0; row < rows; ++row) {
+    for (int column = 0; column < columns; ++column) {
+      Tile tile{column * tileSize, row * tileSize, 0, 0};
+      tile.width = std::min(tileSize, width - tile.x);
+      tile.height = std::min(tileSize, height - tile.y);
+      timings[column + row * columns] = {tile, 0, 0};
+    }
+  }
+
+  pool.run(timings.size(), [&](size_t index, unsigned int thread) {
+    auto start = chrono::steady_clock::now();
+    task(timings[index].tile);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    timings[index].thread = thread;
+    timings[index].seconds = elapsed.count();
+  });
+}
+
+const vector<TileScheduler::Timing> &TileScheduler::getTimings() const {
+  return timings;
+}
+
+unsigned int TileScheduler::getThreadCount() const {
+  return pool.getThreadCount();
+}
+
+void TileScheduler::printStatistics(ostream &output) const {
+  if (timings.empty()) return;
+
+  double total = 0;
+  vector<double> threadTime(pool.getThreadCount(), 0);
+  vector<unsigned int> threadTiles(pool.getThreadCount(), 0);
+  for (auto &timing : timings) {
+    total += timing.seconds;
+    threadTime[timing.thread] += timing.seconds;
+    threadTiles[timing.thread]++;
+  }
+
+  auto sorted = timings;
+  sort(sorted.begin(), sorted.end(), [](const Timing &a, const Timing &b) { return a.seconds > b.seconds; });
+
+  auto flags = output.flags();
+  auto precision = output.precision();
+  output << fixed << setprecision(4);
+  output << "Tiles: " << timings.size() << " of " << tileSize << "x" << tileSize
+         << ", min " << sorted.back().seconds << "s, mean " << total / timings.size()
+         << "s, max " << sorted.front().seconds << "s" << endl;
+
+  output << "Slowest tiles:" << endl;
+  for (size_t i = 0; i < std::min<size_t>(5, sorted.size()); ++i) {
+    auto &tile = sorted[i].tile;
+    output << "  [" << tile.x << ", " << tile.y << "] " << sorted[i].seconds << "s on thread " << sorted[i].thread << endl;
+  }
+
+  output << "Threads:" << endl;
+  for (size_t i = 0; i < threadTime.size(); ++i)
+    output << "  " << i << ": " << threadTiles[i] << " tiles, " << threadTime[i] << "s busy" << endl;
+  output.flags(flags);
+  output.precision(precision);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <ostream>
+#include <functional>
+
+#include "thread_pool.h"
+
+namespace ppgso {
+
+  /*!
+   * Rectangular region of an image
+   */
+  struct Tile {
+    int x, y, width, height;
+  };
+
+  /*!
+   * Splits an image into square tiles and renders them on a work stealing thread pool.
+   * Tiles are much smaller than a thread's share of the image so expensive regions get spread between threads.
+   */
+  class TileScheduler {
+  public:
+    /*!
+     * Timing of a single tile from the last run
+     */
+    struct Timing {
+      Tile tile;
+      unsigned int thread;
+      double seconds;
+    };
+
+    /*!
+     * Create a scheduler with its own thread pool.
+     *
+     * @param threads - Number of threads to use, 0 uses all hardware threads.
+     * @param tileSize - Width and height of a tile in pixels.
+     */
+    explicit TileScheduler(unsigned int threads = 0, int tileSize = 16);
+
+    /*!
+     * Run task for every tile of the image and wait for all of them to finish.
+     *
+     * @param width - Width of the image in pixels.
+     * @param height - Height of the image in pixels.
+     * @param task - Task to render a single tile.
+     */
+    void run(int width, int height, const std::function<void(const Tile &tile)> &task);
+
+    /*!
+     * Get per tile timings of the last run in row major tile order.
+     *
+     * @return - Vector of tile timings.
+     */
+    const std::vector<Timing> &getTimings() const;
+
+    /*!
+     * Print a summary of the last run: tile times, slowest tiles and work done by each thread.
+     *
+     * @param output - Stream to print to.
+     */
+    void printStatistics(std::ostream &output) const;
+
+    /*!
+     * Get the number of threads used.
+     *
+     * @return - Number of threads.
+     */
+    unsigned int getThreadCount() const;
+
+  private:
+    ThreadPool pool;
+    int tileSize;
+    std::vector<Timing> timings;
+  };
+}
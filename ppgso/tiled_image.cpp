@@ -0,0 +1,110 @@
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+#include "tiled_image.h"
+
+using namespace std;
+using namespace ppgso;
+
+// Width and height of a block in the tiled layout
+static const int TILE = 8;
+
+// Smallest power of two not smaller than value
+static uint32_t powerOfTwo(int value) {
+  uint32_t result = 1;
+  while (result < (uint32_t) value) result <<= 1;
+  return result;
+}
+
+TiledImage::TiledImage(int width, int height, Layout layout) : width{width}, height{height}, layout{layout} {
+  offsetX.resize((size_t) width);
+  offsetY.resize((size_t) height);
+
+  if (layout == Layout::Tiled) {
+    uint32_t tilesX = (uint32_t) (width + TILE - 1) / TILE;
+    uint32_t tilesY = (uint32_t) (height + TILE - 1) / TILE;
+    for (uint32_t x = 0; x < (uint32_t) width; ++x)
+      offsetX[x] = x / TILE * TILE * TILE + x % TILE;
+    for (uint32_t y = 0; y < (uint32_t) height; ++y)
+      offsetY[y] = y / TILE * tilesX * TILE * TILE + y % TILE * TILE;
+    pixels.resize((size_t) tilesX * tilesY * TILE * TILE);
+    return;
+  }
+
+  // Bits of x and y alternate starting with x, once the shorter side runs out of bits the rest of the longer one
+  // follows, so the padded image is a row of square Z-order blocks
+  uint32_t paddedWidth = powerOfTwo(width), paddedHeight = powerOfTwo(height);
+  for (uint32_t x = 0; x < (uint32_t) width; ++x) {
+    uint32_t offset = 0, bit = 1;
+    for (uint32_t mask = 1; mask < paddedWidth; mask <<= 1) {
+      if (x & mask) offset |= bit;
+      bit <<= mask < paddedHeight ? 2 : 1;
+    }
+    offsetX[x] = offset;
+  }
+  for (uint32_t y = 0; y < (uint32_t) height; ++y) {
+    uint32_t offset = 0, bit = paddedWidth > 1 ? 2 : 1;
+    for (uint32_t mask = 1; mask < paddedHeight; mask <<= 1) {
+      if (y & mask) offset |= bit;
+      bit <<= (mask << 1) < paddedWidth ? 2 : 1;
+    }
+    offsetY[y] = offset;
+  }
+  pixels.resize((size_t) paddedWidth * paddedHeight);
+}
+
+TiledImage::TiledImage(Image &image, Layout layout) : TiledImage{image.width, image.height, layout} {
+  copyFrom(image);
+}
+
+// Check the size of the row-major image used for conversions
+static void checkSize(const TiledImage &tiled, const Image &image) {
+  if (image.width != tiled.width || image.height != tiled.height) {
+    stringstream msg;
+    msg << "Image size " << image.width << "x" << image.height << " does not match tiled image " << tiled.width
+        << "x" << tiled.height;
+    throw runtime_error(msg.str());
+  }
+}
+
+void TiledImage::copyFrom(Image &image) {
+  checkSize(*this, image);
+  auto source = image.getFramebuffer().data();
+  for (int y = 0; y < height; ++y, source += width) {
+    auto row = pixels.data() + offsetY[y];
+    int x = 0;
+    // Rows of a block are continuous in the tiled layout
+    if (layout == Layout::Tiled) {
+      for (; x + TILE <= width; x += TILE)
+        memcpy(row + offsetX[x], source + x, TILE * sizeof(Image::Pixel));
+    }
+    for (; x < width; ++x)
+      row[offsetX[x]] = source[x];
+  }
+}
+
+void TiledImage::copyTo(Image &image) const {
+  checkSize(*this, image);
+  auto target = image.getFramebuffer().data();
+  for (int y = 0; y < height; ++y, target += width) {
+    auto row = pixels.data() + offsetY[y];
+    int x = 0;
+    if (layout == Layout::Tiled) {
+      for (; x + TILE <= width; x += TILE)
+        memcpy(target + x, row + offsetX[x], TILE * sizeof(Image::Pixel));
+    }
+    for (; x < width; ++x)
+      target[x] = row[offsetX[x]];
+  }
+}
+
+Image TiledImage::toImage() const {
+  Image image{width, height};
+  copyTo(image);
+  return image;
+}
+
+TiledImage::Layout TiledImage::getLayout() const {
+  return layout;
+}
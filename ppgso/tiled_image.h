@@ -0,0 +1,101 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "image.h"
+
+namespace ppgso {
+
+  /*!
+   * Image with pixels stored in a cache friendly order instead of row by row. Neighbouring pixels in both
+   * directions end up close in memory, so texture lookups that walk columns, diagonals or skip pixels when the
+   * texture is rotated or minified touch fewer cache lines than the same lookups in a row-major Image.
+   * The position of a pixel is the sum of a column and a row offset taken from precomputed tables.
+   */
+  class TiledImage {
+  public:
+    /*!
+     * Order of the pixels in memory
+     */
+    enum class Layout {
+      Tiled,  // 8x8 blocks of pixels stored row by row, blocks follow each other row by row
+      Morton  // Z-order curve interleaving the bits of the coordinates, dimensions are padded to powers of two
+    };
+
+    /*!
+     * Create new image with all pixels set to zero.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @param layout - Order of the pixels in memory.
+     */
+    TiledImage(int width, int height, Layout layout = Layout::Tiled);
+
+    /*!
+     * Create a copy of a row-major image.
+     *
+     * @param image - Image to copy.
+     * @param layout - Order of the pixels in memory.
+     */
+    explicit TiledImage(Image &image, Layout layout = Layout::Tiled);
+
+    /*!
+     * Get single pixel.
+     *
+     * @param x - X position of the pixel.
+     * @param y - Y position of the pixel.
+     * @return - Reference to the pixel.
+     */
+    const Image::Pixel &getPixel(int x, int y) const {
+      return pixels[offsetX[x] + offsetY[y]];
+    }
+
+    Image::Pixel &getPixel(int x, int y) {
+      return pixels[offsetX[x] + offsetY[y]];
+    }
+
+    /*!
+     * Set pixel on coordinates x and y
+     * @param x Horizontal coordinate
+     * @param y Vertical coordinate
+     * @param color Pixel color to set
+     */
+    void setPixel(int x, int y, const Image::Pixel &color) {
+      pixels[offsetX[x] + offsetY[y]] = color;
+    }
+
+    /*!
+     * Copy pixels from a row-major image of the same size.
+     *
+     * @param image - Image to copy from.
+     */
+    void copyFrom(Image &image);
+
+    /*!
+     * Copy pixels to a row-major image of the same size.
+     *
+     * @param image - Image to copy to.
+     */
+    void copyTo(Image &image) const;
+
+    /*!
+     * Create a row-major copy of the image.
+     *
+     * @return - New image with the same pixels.
+     */
+    Image toImage() const;
+
+    /*!
+     * Get the order of the pixels in memory.
+     *
+     * @return - Layout of the image.
+     */
+    Layout getLayout() const;
+
+    int width, height;
+  private:
+    Layout layout;
+    std::vector<uint32_t> offsetX, offsetY;
+    std::vector<Image::Pixel> pixels;
+  };
+}
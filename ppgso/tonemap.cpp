@@ -0,0 +1,59 @@
+#include <sstream>
+#include <stdexcept>
+
+#include "tonemap.h"
+
+using namespace std;
+using namespace glm;
+
+namespace ppgso {
+  namespace tonemap {
+
+    // Rec. 709 luminance weights
+    static const vec3 LUMINANCE{0.2126f, 0.7152f, 0.0722f};
+
+    Operator parse(const string &name) {
+      if (name == "clamp") return Operator::Clamp;
+      if (name == "reinhard") return Operator::Reinhard;
+      if (name == "aces") return Operator::ACES;
+
+      stringstream msg;
+      msg << "Unknown tone mapping operator " << name << ", use clamp, reinhard or aces.";
+      throw runtime_error(msg.str());
+    }
+
+    vec3 map(const vec3 &color, Operator op, float exposure, float gamma) {
+      vec3 result = max(color * exposure, 0.0f);
+      switch (op) {
+        case Operator::Clamp:
+          break;
+        case Operator::Reinhard:
+          result /= 1.0f + dot(result, LUMINANCE);
+          break;
+        case Operator::ACES:
+          result = (result * (2.51f * result + 0.03f)) / (result * (2.43f * result + 0.59f) + 0.14f);
+          break;
+      }
+      result = clamp(result, 0.0f, 1.0f);
+      if (gamma != 1.0f) result = pow(result, vec3{1.0f / gamma});
+      return result;
+    }
+
+    void apply(const FloatImage &hdr, Image &ldr, Operator op, float exposure, float gamma) {
+      if (hdr.width != ldr.width || hdr.height != ldr.height) {
+        stringstream msg;
+        msg << "Tone mapped images differ in size " << hdr.width << "x" << hdr.height << " and "
+            << ldr.width << "x" << ldr.height;
+        throw runtime_error(msg.str());
+      }
+
+      auto &source = hdr.getFramebuffer();
+      auto &target = ldr.getFramebuffer();
+      for (size_t i = 0; i < source.size(); ++i) {
+        // Round to the nearest 8 bit value
+        vec3 color = map(source[i], op, exposure, gamma) * 255.0f + 0.5f;
+        target[i] = {(uint8_t) color.r, (uint8_t) color.g, (uint8_t) color.b};
+      }
+    }
+  }
+}
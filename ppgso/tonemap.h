@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+
+#include "image.h"
+#include "image_hdr.h"
+
+namespace ppgso {
+  namespace tonemap {
+
+    /*!
+     * Operators that map high dynamic range colors to the <0, 1> range
+     */
+    enum class Operator {
+      Clamp,     // Colors above 1 are clipped
+      Reinhard,  // Luminance is compressed using L / (1 + L), keeps the hue of bright colors
+      ACES       // Filmic curve fitted to the ACES reference transform (Narkowicz 2015)
+    };
+
+    /*!
+     * Parse the name of an operator.
+     *
+     * @param name - One of "clamp", "reinhard" or "aces".
+     * @return - Operator matching the name.
+     */
+    Operator parse(const std::string &name);
+
+    /*!
+     * Map a single linear color to the displayable range.
+     *
+     * @param color - Linear color.
+     * @param op - Tone mapping operator.
+     * @param exposure - Scale applied to the color before tone mapping.
+     * @param gamma - Gamma of the display, 1 keeps the result linear.
+     * @return - Color in the <0, 1> range.
+     */
+    glm::vec3 map(const glm::vec3 &color, Operator op, float exposure = 1.0f, float gamma = 1.0f);
+
+    /*!
+     * Tone map a floating point image to an 8 bit image of the same size.
+     *
+     * @param hdr - Linear high dynamic range image.
+     * @param ldr - Image to store the result to.
+     * @param op - Tone mapping operator.
+     * @param exposure - Scale applied to the colors before tone mapping.
+     * @param gamma - Gamma of the display, 1 keeps the result linear.
+     */
+    void apply(const FloatImage &hdr, Image &ldr, Operator op, float exposure = 1.0f, float gamma = 1.0f);
+  }
+}
@@ -0,0 +1,139 @@
+#include <sstream>
+#include <stdexcept>
+
+#include "triangle_set.h"
+#include "tiny_obj_loader.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+void TriangleSet::load(const string &obj_file, uint32_t material) {
+  vector<tinyobj::shape_t> shapes;
+  vector<tinyobj::material_t> materials;
+  string err = tinyobj::LoadObj(shapes, materials, obj_file.c_str());
+
+  if (!err.empty()) {
+    stringstream msg;
+    msg << err << endl << "Failed to load OBJ file " << obj_file << "!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  for (auto &shape : shapes) {
+    auto &mesh = shape.mesh;
+    auto base = (uint32_t) vertices.size();
+    for (size_t i = 0; i + 2 < mesh.positions.size(); i += 3)
+      vertices.emplace_back(mesh.positions[i], mesh.positions[i + 1], mesh.positions[i + 2]);
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+      triangles.push_back({{base + mesh.indices[i], base + mesh.indices[i + 1], base + mesh.indices[i + 2]}, material});
+  }
+}
+
+void TriangleSet::add(const dvec3 &a, const dvec3 &b, const dvec3 &c, uint32_t material) {
+  auto base = (uint32_t) vertices.size();
+  vertices.emplace_back(a);
+  vertices.emplace_back(b);
+  vertices.emplace_back(c);
+  triangles.push_back({{base, base + 1, base + 2}, material});
+}
+
+void TriangleSet::transform(const dmat4 &matrix, size_t firstVertex) {
+  for (size_t i = firstVertex; i < vertices.size(); ++i)
+    vertices[i] = vec3{matrix * dvec4{dvec3{vertices[i]}, 1.0}};
+}
+
+void TriangleSet::build() {
+  vector<BoundingBox> bounds;
+  bounds.reserve(triangles.size());
+  for (auto &triangle : triangles) {
+    BoundingBox box;
+    for (auto vertex : triangle.vertices)
+      box.extend(dvec3{vertices[vertex]});
+    bounds.push_back(box);
+  }
+  bvh.build(bounds);
+
+  vector<Triangle> ordered;
+  ordered.reserve(triangles.size());
+  for (auto index : bvh.getIndices())
+    ordered.push_back(triangles[index]);
+  triangles = move(ordered);
+}
+
+bool TriangleSet::intersect(const dvec3 &origin, const dvec3 &direction, double tMin, double &tMax,
+                            uint32_t &triangle) const {
+  // Permute axes so the ray direction is largest along z, keep the winding by swapping x and y when needed
+  dvec3 magnitude = abs(direction);
+  int kz = magnitude.x > magnitude.y ? (magnitude.x > magnitude.z ? 0 : 2) : (magnitude.y > magnitude.z ? 1 : 2);
+  int kx = (kz + 1) % 3;
+  int ky = (kx + 1) % 3;
+  if (direction[kz] < 0) std::swap(kx, ky);
+
+  // Shear transforming the ray to the unit z axis
+  double sx = direction[kx] / direction[kz];
+  double sy = direction[ky] / direction[kz];
+  double sz = 1.0 / direction[kz];
+
+  bool found = false;
+  bvh.traverse(origin, direction, tMax, [&](uint32_t first, uint32_t count, double &tMax) {
+    for (uint32_t i = first; i < first + count; ++i) {
+      auto &t = triangles[i];
+      dvec3 a = dvec3{vertices[t.vertices[0]]} - origin;
+      dvec3 b = dvec3{vertices[t.vertices[1]]} - origin;
+      dvec3 c = dvec3{vertices[t.vertices[2]]} - origin;
+
+      // Vertices in ray space projected to the xy plane
+      double ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+      double bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+      double cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+      // Scaled barycentric coordinates, the ray hits when all have the same sign. Each one only depends on
+      // the two vertices of an edge, so triangles sharing the edge agree on the side the ray passes
+      double u = cx * by - cy * bx;
+      double v = ax * cy - ay * cx;
+      double w = bx * ay - by * ax;
+      if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) continue;
+
+      double determinant = u + v + w;
+      if (determinant == 0) continue;
+
+      // Distance is compared scaled by the determinant to avoid the division for misses
+      double distance = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+      if (determinant < 0) {
+        distance = -distance;
+        determinant = -determinant;
+      }
+      if (distance <= tMin * determinant || distance >= tMax * determinant) continue;
+
+      tMax = distance / determinant;
+      triangle = i;
+      found = true;
+    }
+  });
+  return found;
+}
+
+dvec3 TriangleSet::getNormal(uint32_t triangle) const {
+  auto &t = triangles[triangle];
+  dvec3 a{vertices[t.vertices[0]]}, b{vertices[t.vertices[1]]}, c{vertices[t.vertices[2]]};
+  return normalize(cross(b - a, c - a));
+}
+
+uint32_t TriangleSet::getMaterial(uint32_t triangle) const {
+  return triangles[triangle].material;
+}
+
+BoundingBox TriangleSet::getBounds(size_t firstVertex) const {
+  BoundingBox bounds;
+  for (size_t i = firstVertex; i < vertices.size(); ++i)
+    bounds.extend(dvec3{vertices[i]});
+  return bounds;
+}
+
+size_t TriangleSet::size() const {
+  return triangles.size();
+}
+
+size_t TriangleSet::getVertexCount() const {
+  return vertices.size();
+}
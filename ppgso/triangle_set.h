@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+namespace ppgso {
+
+  /*!
+   * Compact store of triangles for ray tracing.
+   *
+   * Vertices are shared between triangles and kept in single precision, each triangle only stores three vertex
+   * indices and a material index. Rays are tested against the triangles using the watertight algorithm
+   * (Woop, Benthin and Wald 2013) so rays never slip through edges shared by neighbouring triangles,
+   * the triangles are organized in a bounding volume hierarchy.
+   */
+  class TriangleSet {
+  public:
+    /*!
+     * Load all shapes of an OBJ file, polygons are split to triangles.
+     *
+     * @param obj_file - File to load.
+     * @param material - Material index assigned to the loaded triangles.
+     */
+    void load(const std::string &obj_file, uint32_t material = 0);
+
+    /*!
+     * Add a single triangle.
+     *
+     * @param a - First vertex.
+     * @param b - Second vertex.
+     * @param c - Third vertex.
+     * @param material - Material index of the triangle.
+     */
+    void add(const glm::dvec3 &a, const glm::dvec3 &b, const glm::dvec3 &c, uint32_t material = 0);
+
+    /*!
+     * Transform vertices added so far.
+     *
+     * @param matrix - Transformation matrix.
+     * @param firstVertex - Only vertices from this index on are transformed, see getVertexCount.
+     */
+    void transform(const glm::dmat4 &matrix, size_t firstVertex = 0);
+
+    /*!
+     * Build the bounding volume hierarchy, needs to be called after triangles are added and before intersect.
+     * Triangles are reordered to match the leaves of the hierarchy.
+     */
+    void build();
+
+    /*!
+     * Find the closest triangle hit by a ray.
+     *
+     * @param origin - Origin of the ray.
+     * @param direction - Direction of the ray, does not need to be normalized.
+     * @param tMin - Minimal distance on the ray.
+     * @param tMax - Maximal distance on the ray, lowered to the distance of the hit.
+     * @param triangle - Index of the hit triangle.
+     * @return - True when a triangle closer than tMax was hit.
+     */
+    bool intersect(const glm::dvec3 &origin, const glm::dvec3 &direction, double tMin, double &tMax,
+                   uint32_t &triangle) const;
+
+    /*!
+     * Get the geometric normal of a triangle, it points to the side the vertices are ordered counter-clockwise.
+     *
+     * @param triangle - Index of the triangle.
+     * @return - Normalized normal.
+     */
+    glm::dvec3 getNormal(uint32_t triangle) const;
+
+    /*!
+     * Get the material index of a triangle.
+     *
+     * @param triangle - Index of the triangle.
+     * @return - Material index.
+     */
+    uint32_t getMaterial(uint32_t triangle) const;
+
+    /*!
+     * Get the bounding box of vertices from the given index on.
+     *
+     * @param firstVertex - Index of the first vertex to include.
+     * @return - Bounding box.
+     */
+    BoundingBox getBounds(size_t firstVertex = 0) const;
+
+    /*!
+     * Get number of triangles.
+     *
+     * @return - Number of triangles.
+     */
+    size_t size() const;
+
+    /*!
+     * Get number of vertices.
+     *
+     * @return - Number of vertices.
+     */
+    size_t getVertexCount() const;
+
+  private:
+    struct Triangle {
+      uint32_t vertices[3];
+      uint32_t material;
+    };
+
+    std::vector<glm::vec3> vertices;
+    std::vector<Triangle> triangles;
+    BVH bvh;
+  };
+}
@@ -0,0 +1,207 @@
+// Benchmark bench_convolution
+// - Compares a naive per-pixel convolution, as written in task2_convolution, with the convolution library
+// - Direct convolution sums whole padded rows per kernel row, separable kernels run two 1D passes
+// - Measures a small Gaussian, a non-separable 5x5 kernel and a large box blur
+// - Reports megapixels per second and the largest difference against the naive result
+// - Compares separable kernels of large blurs with running sum box blurs, a summed-area table and a Gaussian
+//   made of three box blurs, their cost does not depend on the radius
+// - Compares direct and FFT convolution of a large non-separable bokeh kernel and shows the automatic choice
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <ppgso/ppgso.h>
+
+using namespace std;
+using namespace ppgso;
+using namespace ppgso::convolution;
+
+/*!
+ * Convolve an image pixel by pixel with clamped borders, same as the task2_convolution solution
+ * @param source Image to filter
+ * @param target Image to store the result to
+ * @param kernel Convolution kernel
+ */
+void convolveNaive(Image &source, Image &target, const Kernel &kernel) {
+  for (int y = 0; y < source.height; ++y) {
+    for (int x = 0; x < source.width; ++x) {
+      float r = 0, g = 0, b = 0;
+      for (int ky = 0; ky < kernel.height; ++ky) {
+        for (int kx = 0; kx < kernel.width; ++kx) {
+          int sx = min(max(x + kx - kernel.width / 2, 0), source.width - 1);
+          int sy = min(max(y + ky - kernel.height / 2, 0), source.height - 1);
+          auto &pixel = source.getPixel(sx, sy);
+          float weight = kernel.get(kx, ky);
+          r += weight * pixel.r / 255.0f;
+          g += weight * pixel.g / 255.0f;
+          b += weight * pixel.b / 255.0f;
+        }
+      }
+      r = min(max(r / kernel.factor + kernel.bias, 0.0f), 1.0f);
+      g = min(max(g / kernel.factor + kernel.bias, 0.0f), 1.0f);
+      b = min(max(b / kernel.factor + kernel.bias, 0.0f), 1.0f);
+      target.setPixel(x, y, r, g, b);
+    }
+  }
+}
+
+/*!
+ * Largest difference of a single channel between two images
+ * @param a First image
+ * @param b Second image
+ * @return Difference in 8 bit steps
+ */
+int maxDifference(Image &a, Image &b) {
+  auto &pixelsA = a.getFramebuffer();
+  auto &pixelsB = b.getFramebuffer();
+  int difference = 0;
+  for (size_t i = 0; i < pixelsA.size(); ++i) {
+    difference = max(difference, abs(pixelsA[i].r - pixelsB[i].r));
+    difference = max(difference, abs(pixelsA[i].g - pixelsB[i].g));
+    difference = max(difference, abs(pixelsA[i].b - pixelsB[i].b));
+  }
+  return difference;
+}
+
+/*!
+ * Run a filter repeatedly and print its throughput
+ * @param name Name of the measured method
+ * @param pixels Number of pixels processed by a single run
+ * @param iterations Number of runs
+ * @param filter Operation to measure
+ */
+void measure(const string &name, size_t pixels, int iterations, const function<void()> &filter) {
+  filter();
+
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+    filter();
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  cout << "  " << name << ": " << elapsed.count() / iterations * 1000.0 << " ms per run, "
+       << pixels * iterations / elapsed.count() / 1e6 << " Mpixels/s";
+}
+
+int main(int argc, char *argv[]) {
+  // Command line options
+  int size = 1024;
+  int iterations = 5;
+  unsigned int threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = stoi(argv[++i]);
+    } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = stoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = (unsigned int) stoi(argv[++i]);
+    } else {
+      cerr << "Usage: " << argv[0] << " [--size <pixels>] [--iterations <count>] [--threads <count>]" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Generate test image
+  Image source{size, size};
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x)
+      source.setPixel(x, y, x & 0xff, y & 0xff, (x ^ y) & 0xff);
+  Image expected{size, size}, result{size, size};
+
+  // Sharpening kernel, rows are not multiples of each other
+  Kernel sharpen{5, 5, {
+      -1, -1, -1, -1, -1,
+      -1, 2, 2, 2, -1,
+      -1, 2, 8, 2, -1,
+      -1, 2, 2, 2, -1,
+      -1, -1, -1, -1, -1}, 8.0f};
+
+  struct Test {
+    string name;
+    Kernel kernel;
+  };
+  vector<Test> tests{
+      {"Gaussian sigma 2", Kernel::gaussian(2.0f)},
+      {"Sharpen 5x5", sharpen},
+      {"Box 31x31", Kernel::box(15)}
+  };
+
+  Convolution convolution{threads};
+  auto pixels = (size_t) size * size;
+  cout << "Filtering " << size << "x" << size << " image " << iterations << " times using "
+       << convolution.getThreadCount() << " threads" << endl;
+  for (auto &test : tests) {
+    auto &kernel = test.kernel;
+    cout << test.name << " (" << kernel.width << "x" << kernel.height
+         << (kernel.isSeparable() ? ", separable)" : ")") << endl;
+
+    measure("naive", pixels, iterations, [&] { convolveNaive(source, expected, kernel); });
+    cout << endl;
+
+    measure("direct", pixels, iterations, [&] {
+      convolution.apply(source, result, kernel, Border::Clamp, Method::Direct);
+    });
+    cout << ", max difference " << maxDifference(expected, result) << endl;
+
+    if (kernel.isSeparable()) {
+      measure("separable", pixels, iterations, [&] {
+        convolution.apply(source, result, kernel, Border::Clamp, Method::Separable);
+      });
+      cout << ", max difference " << maxDifference(expected, result) << endl;
+    }
+
+    measure("FFT", pixels, iterations, [&] {
+      convolution.apply(source, result, kernel, Border::Clamp, Method::FFT);
+    });
+    cout << ", max difference " << maxDifference(expected, result) << endl;
+  }
+
+  // Large blurs are compared with the separable kernels as the naive loop would take minutes
+  cout << "Large blurs" << endl;
+  for (int radius : {15, 50}) {
+    cout << "Box radius " << radius << endl;
+    measure("separable", pixels, iterations, [&] {
+      convolution.apply(source, expected, Kernel::box(radius), Border::Clamp, Method::Separable);
+    });
+    cout << endl;
+    measure("running sums", pixels, iterations, [&] { convolution.boxBlur(source, result, radius); });
+    cout << ", max difference " << maxDifference(expected, result) << endl;
+    measure("summed-area table", pixels, iterations, [&] { SummedAreaTable{source}.blur(result, radius); });
+    cout << ", max difference " << maxDifference(expected, result) << " (window cut at the border)" << endl;
+  }
+  for (float sigma : {10.0f, 30.0f}) {
+    cout << "Gaussian sigma " << sigma << endl;
+    measure("separable", pixels, iterations, [&] {
+      convolution.apply(source, expected, Kernel::gaussian(sigma), Border::Mirror, Method::Separable);
+    });
+    cout << endl;
+    measure("3 box blurs", pixels, iterations, [&] {
+      convolution.gaussianBlur(source, result, sigma, Border::Mirror);
+    });
+    cout << ", max difference " << maxDifference(expected, result) << endl;
+  }
+
+  // Disc shaped kernel of out of focus highlights, has no separable form
+  int radius = 31;
+  vector<float> disc;
+  for (int y = -radius; y <= radius; ++y)
+    for (int x = -radius; x <= radius; ++x)
+      disc.push_back(x * x + y * y <= radius * radius ? 1.0f : 0.0f);
+  float discArea = 0;
+  for (auto weight : disc)
+    discArea += weight;
+  Kernel bokeh{radius * 2 + 1, radius * 2 + 1, disc, discArea};
+
+  cout << "Bokeh disc " << bokeh.width << "x" << bokeh.height << endl;
+  measure("direct", pixels, iterations, [&] {
+    convolution.apply(source, expected, bokeh, Border::Clamp, Method::Direct);
+  });
+  cout << endl;
+  measure("FFT", pixels, iterations, [&] { convolution.apply(source, result, bokeh, Border::Clamp, Method::FFT); });
+  cout << ", max difference " << maxDifference(expected, result) << endl;
+  measure("automatic", pixels, iterations, [&] { convolution.apply(source, result, bokeh); });
+  cout << ", max difference " << maxDifference(expected, result) << endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,360 @@
+// Benchmark bench_image
+// - Measures throughput of loading RAW and BMP images
+// - Compares the original stream based loaders with loaders using memory mapped files
+// - Also measures direct access to the mapped pixels without creating an image
+// - Measures BGR/RGB swizzle kernels on a single row in cache and on a whole image
+// - Measures conversion of 32 bit BGRA pixels used by 32 bit BMP images
+// - Compares converting a batch of BMP images one by one with the ImagePipeline
+// - Compares allocating a new scratch image with reusing one from an ImagePool
+// - Measures clearing images and float buffers in place with each kernel
+// - Compares texture lookups on a rotated and minified grid in row-major, tiled and Morton ordered images
+// - Test images are generated in the working directory and removed afterwards
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <cmath>
+#include <ppgso/ppgso.h>
+
+using namespace std;
+using namespace ppgso;
+
+/*!
+ * Load RAW image using an input stream, same as the library did before memory mapping
+ * @param raw RAW file to load
+ * @param width Width of the image
+ * @param height Height of the image
+ * @return Loaded image
+ */
+Image loadRAWStream(const string &raw, int width, int height) {
+  Image image{width, height};
+  auto &framebuffer = image.getFramebuffer();
+
+  ifstream image_stream(raw, ios::binary);
+  if (!image_stream.is_open()) {
+    stringstream msg;
+    msg << "Could not open image " << raw;
+    throw runtime_error(msg.str());
+  }
+
+  image_stream.read((char *) framebuffer.data(), framebuffer.size() * sizeof(Image::Pixel));
+  return image;
+}
+
+/*!
+ * Load 24 bit BMP image using an input stream with a temporary vector for every row,
+ * same as the library did before memory mapping
+ * @param bmp BMP file to load
+ * @return Loaded image
+ */
+Image loadBMPStream(const string &bmp) {
+  ifstream input_file(bmp, ios::binary);
+  if (!input_file.is_open()) {
+    stringstream msg;
+    msg << "Could not open BMP file. " << bmp;
+    throw runtime_error(msg.str());
+  }
+
+  // Only the fields needed for 24 bit images written by saveBMP are read
+  char header[54];
+  input_file.read(header, sizeof(header));
+  unsigned int offset;
+  int width, height;
+  memcpy(&offset, header + 10, sizeof(offset));
+  memcpy(&width, header + 18, sizeof(width));
+  memcpy(&height, header + 22, sizeof(height));
+  bool flipped = height < 0;
+  height = abs(height);
+
+  Image image{width, height};
+  auto &framebuffer = image.getFramebuffer();
+  input_file.seekg(offset, input_file.beg);
+
+  unsigned int row_padded = (width * sizeof(Image::Pixel) + 3) & (~3);
+  for (int j = 0; j < height; j++) {
+    auto row_data = vector<Image::Pixel>(row_padded);
+    input_file.read((char *) row_data.data(), row_padded);
+    for (int i = 0; i < width; i++) {
+      auto pixel = row_data[i];
+      swap(pixel.r, pixel.b);
+      if (flipped) {
+        framebuffer[i + j * width] = pixel;
+      } else {
+        framebuffer[i + (height - 1 - j) * width] = pixel;
+      }
+    }
+  }
+  return image;
+}
+
+/*!
+ * Sum all channels of an image so the work can not be optimized away
+ * @param image Image to sum
+ * @return Sum of all channels
+ */
+uint64_t checksum(Image &image) {
+  uint64_t sum = 0;
+  for (auto &pixel : image.getFramebuffer())
+    sum += pixel.r + pixel.g + pixel.b;
+  return sum;
+}
+
+/*!
+ * Sum all channels of a mapped image directly from the file
+ * @param image Mapped image to sum
+ * @return Sum of all channels
+ */
+uint64_t checksum(const MappedImage &image) {
+  uint64_t sum = 0;
+  for (int y = 0; y < image.height; ++y) {
+    auto row = image.getRow(y);
+    for (int x = 0; x < image.width; ++x)
+      sum += row[x].r + row[x].g + row[x].b;
+  }
+  return sum;
+}
+
+/*!
+ * Sample a texture on a rotated and scaled grid, same as a rasterizer sampling a rotated or minified texture
+ * @param texture Texture to sample, its size has to be a power of two
+ * @param angle Rotation of the grid in radians
+ * @param scale Distance between neighbouring samples in texels
+ * @return Sum of all sampled channels
+ */
+template<typename Texture>
+uint64_t sampleGrid(Texture &texture, double angle, double scale) {
+  int size = texture.width, mask = size - 1;
+  double dx = cos(angle) * scale, dy = sin(angle) * scale;
+  uint64_t sum = 0;
+  for (int v = 0; v < size; ++v) {
+    for (int u = 0; u < size; ++u) {
+      // Texture wraps around, coordinates are kept positive by the offset
+      auto x = (int) (size * 64 + (u - size / 2) * dx - (v - size / 2) * dy) & mask;
+      auto y = (int) (size * 64 + (u - size / 2) * dy + (v - size / 2) * dx) & mask;
+      auto &pixel = texture.getPixel(x, y);
+      sum += pixel.r + pixel.g + pixel.b;
+    }
+  }
+  return sum;
+}
+
+/*!
+ * Run a loader repeatedly and print its throughput
+ * @param name Name of the measured method
+ * @param bytes Number of pixel bytes processed by a single run
+ * @param iterations Number of runs
+ * @param load Operation to measure, returns a checksum of the processed pixels
+ */
+void measure(const string &name, size_t bytes, int iterations, const function<uint64_t()> &load) {
+  // Warm up the page cache
+  auto expected = load();
+
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    if (load() != expected) throw runtime_error("Loaded images differ between runs");
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  cout << "  " << name << ": " << elapsed.count() / iterations * 1000.0 << " ms per run, "
+       << bytes * iterations / elapsed.count() / 1e9 << " GB/s (checksum " << expected << ")" << endl;
+}
+
+int main(int argc, char *argv[]) {
+  // Command line options
+  int size = 2048;
+  int iterations = 20;
+  int batch = 16;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = stoi(argv[++i]);
+    } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = stoi(argv[++i]);
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batch = stoi(argv[++i]);
+    } else {
+      cerr << "Usage: " << argv[0] << " [--size <pixels>] [--iterations <count>] [--batch <images>]" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Generate test images
+  Image image{size, size};
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x)
+      image.setPixel(x, y, x & 0xff, y & 0xff, (x ^ y) & 0xff);
+  image::saveRAW(image, "bench_image.raw");
+  image::saveBMP(image, "bench_image.bmp");
+  size_t bytes = image.getFramebuffer().size() * sizeof(Image::Pixel);
+
+  cout << "Loading " << size << "x" << size << " images " << iterations << " times" << endl;
+  cout << "RAW" << endl;
+  measure("stream", bytes, iterations, [&] {
+    auto loaded = loadRAWStream("bench_image.raw", size, size);
+    return checksum(loaded);
+  });
+  measure("mapped", bytes, iterations, [&] {
+    auto loaded = image::loadRAW("bench_image.raw", size, size);
+    return checksum(loaded);
+  });
+  measure("mapped in place", bytes, iterations, [&] {
+    return checksum(image::mapRAW("bench_image.raw", size, size));
+  });
+
+  cout << "BMP" << endl;
+  measure("stream", bytes, iterations, [&] {
+    auto loaded = loadBMPStream("bench_image.bmp");
+    return checksum(loaded);
+  });
+  measure("mapped", bytes, iterations, [&] {
+    auto loaded = image::loadBMP("bench_image.bmp");
+    return checksum(loaded);
+  });
+  measure("mapped in place", bytes, iterations, [&] {
+    return checksum(image::mapBMP("bench_image.bmp"));
+  });
+  measure("save", bytes, iterations, [&] {
+    image::saveBMP(image, "bench_image.bmp");
+    return (uint64_t) 0;
+  });
+
+  cout << "BGR/RGB swizzle" << endl;
+  auto source = (const uint8_t *) image.getFramebuffer().data();
+  vector<uint8_t> target(bytes);
+  vector<uint8_t> bgra((size_t) size * size * 4);
+  for (size_t i = 0; i < bgra.size(); ++i)
+    bgra[i] = (uint8_t) i;
+  size_t rowBytes = (size_t) size * sizeof(Image::Pixel);
+  for (auto kernel : {pixel::Kernel::Scalar, pixel::Kernel::SSSE3, pixel::Kernel::AVX2}) {
+    pixel::setKernel(kernel);
+    // A single row stays in the cache and measures the kernel itself
+    measure(pixel::getKernelName() + " row", rowBytes, iterations * size, [&] {
+      pixel::swapRedBlue(source, target.data(), (size_t) size);
+      return (uint64_t) target[0] + target[rowBytes - 1];
+    });
+    measure(pixel::getKernelName() + " image", bytes, iterations, [&] {
+      pixel::swapRedBlue(source, target.data(), (size_t) size * size);
+      return (uint64_t) target[0] + target[bytes - 1];
+    });
+    measure(pixel::getKernelName() + " BGRA image", bgra.size(), iterations, [&] {
+      pixel::bgraToRGB(bgra.data(), target.data(), (size_t) size * size);
+      return (uint64_t) target[0] + target[bytes - 1];
+    });
+  }
+  pixel::setKernel(pixel::Kernel::Automatic);
+
+  // Clearing by building a new vector is how Image::clear used to work
+  cout << "Clear" << endl;
+  Image cleared{size, size};
+  vector<float> depth((size_t) size * size);
+  measure("new vector", bytes, iterations, [&] {
+    auto &framebuffer = cleared.getFramebuffer();
+    framebuffer = vector<Image::Pixel>(framebuffer.size(), Image::Pixel{1, 2, 3});
+    return (uint64_t) framebuffer.back().b;
+  });
+  for (auto kernel : {pixel::Kernel::Scalar, pixel::Kernel::SSSE3, pixel::Kernel::AVX2}) {
+    pixel::setKernel(kernel);
+    measure(pixel::getKernelName() + " image", bytes, iterations, [&] {
+      cleared.clear({1, 2, 3});
+      return (uint64_t) cleared.getFramebuffer().back().b;
+    });
+    measure(pixel::getKernelName() + " float buffer", depth.size() * sizeof(float), iterations, [&] {
+      pixel::fill(depth.data(), 1.0f, depth.size());
+      return (uint64_t) depth.back();
+    });
+  }
+  pixel::setKernel(pixel::Kernel::Automatic);
+
+  // Texture lookups use the largest power of two texture that fits the size
+  int textureSize = 1;
+  while (textureSize * 2 <= size) textureSize *= 2;
+  Image texture{textureSize, textureSize};
+  for (int y = 0; y < textureSize; ++y)
+    for (int x = 0; x < textureSize; ++x)
+      texture.setPixel(x, y, x & 0xff, y & 0xff, (x ^ y) & 0xff);
+  TiledImage tiled{texture, TiledImage::Layout::Tiled};
+  TiledImage morton{texture, TiledImage::Layout::Morton};
+  size_t lookups = (size_t) textureSize * textureSize * sizeof(Image::Pixel);
+
+  cout << "Texture lookups on " << textureSize << "x" << textureSize << " texture" << endl;
+  struct Grid {
+    string name;
+    double angle, scale;
+  };
+  for (auto &grid : {Grid{"straight", 0, 1}, Grid{"rotated 90", PI / 2, 1}, Grid{"rotated 30", PI / 6, 1},
+                     Grid{"minified 4x rotated 30", PI / 6, 4}}) {
+    measure(grid.name + " row-major", lookups, iterations, [&] {
+      return sampleGrid(texture, grid.angle, grid.scale);
+    });
+    measure(grid.name + " tiled", lookups, iterations, [&] {
+      return sampleGrid(tiled, grid.angle, grid.scale);
+    });
+    measure(grid.name + " Morton", lookups, iterations, [&] {
+      return sampleGrid(morton, grid.angle, grid.scale);
+    });
+  }
+  measure("convert to tiled", lookups, iterations, [&] {
+    tiled.copyFrom(texture);
+    return (uint64_t) tiled.getPixel(textureSize - 1, textureSize - 1).r;
+  });
+  measure("convert from tiled", lookups, iterations, [&] {
+    tiled.copyTo(texture);
+    return (uint64_t) texture.getPixel(textureSize - 1, textureSize - 1).r;
+  });
+  measure("convert to Morton", lookups, iterations, [&] {
+    morton.copyFrom(texture);
+    return (uint64_t) morton.getPixel(textureSize - 1, textureSize - 1).r;
+  });
+
+  // Scratch image filled once per use, a new image is allocated and paged in every time
+  cout << "Scratch images" << endl;
+  measure("new image", bytes, iterations, [&] {
+    Image scratch{size, size};
+    fill(scratch.getFramebuffer().begin(), scratch.getFramebuffer().end(), Image::Pixel{1, 2, 3});
+    return (uint64_t) scratch.getPixel(size - 1, size - 1).b;
+  });
+  ImagePool pool;
+  measure("pooled image", bytes, iterations, [&] {
+    auto scratch = pool.lease(size, size);
+    fill(scratch->getFramebuffer().begin(), scratch->getFramebuffer().end(), Image::Pixel{1, 2, 3});
+    return (uint64_t) scratch->getPixel(size - 1, size - 1).b;
+  });
+
+  // Batch of BMP images converted through the same invert filter
+  vector<ImagePipeline::Job> jobs;
+  for (int i = 0; i < batch; ++i) {
+    auto name = to_string(i) + ".bmp";
+    image::saveBMP(image, "bench_image_in" + name);
+    jobs.push_back({"bench_image_in" + name, "bench_image_out" + name});
+  }
+  auto invert = [](Image &image) {
+    for (auto &pixel : image.getFramebuffer())
+      pixel = {(uint8_t) (255 - pixel.r), (uint8_t) (255 - pixel.g), (uint8_t) (255 - pixel.b)};
+  };
+  ImagePipeline pipeline;
+
+  cout << "Batch of " << batch << " BMP images" << endl;
+  measure("sequential", bytes * batch, max(iterations / 4, 1), [&] {
+    for (auto &job : jobs) {
+      auto loaded = pipeline.load(job.input);
+      invert(loaded);
+      pipeline.save(loaded, job.output);
+    }
+    return (uint64_t) 0;
+  });
+  measure("pipeline", bytes * batch, max(iterations / 4, 1), [&] {
+    pipeline.run(jobs, invert);
+    return (uint64_t) 0;
+  });
+
+  for (auto &job : jobs) {
+    remove(job.input.c_str());
+    remove(job.output.c_str());
+  }
+  remove("bench_image.raw");
+  remove("bench_image.bmp");
+  return EXIT_SUCCESS;
+}
@@ -3,8 +3,13 @@
 // - Casts rays from camera space into scene
 // - Computes collisions with scene geometry
 // - For each collision point calculates lighting
+// - Image tiles are rendered in parallel using a work stealing thread pool
+// - Sample positions come from scrambled Sobol sequence by default, see --sampler for other samplers
+// - With --stream finished tiles are written straight to the file, so large --size renders need little memory
 
 #include <iostream>
+#include <cstring>
+#include <stdexcept>
 #include <ppgso/ppgso.h>
 
 using namespace std;
@@ -66,9 +71,12 @@ struct Camera {
  * @param y Vertical position in the viewport
  * @param width Width of the viewport
  * @param height Height of the viewport
+ * @param sample Sample stream that provides the deviation
  * @return Ray for the giver viewport position with small random deviation applied to support multi-sampling
  */
-  Ray generateRay(int x, int y, int width, int height) const {
+  Ray generateRay(int x, int y, int width, int height, SampleStream &sample) const {
+    dvec2 offset = sample.get2D();
+
     // Camera deltas
     dvec3 vdu = 2.0 * right / (double)width;
     dvec3 vdv = 2.0 * -up / (double)height;
@@ -76,8 +84,8 @@ struct Camera {
     Ray ray;
     ray.origin = position;
     ray.direction = -back
-                    + vdu * ((double)(-width/2 + x) + linearRand(0.0, 1.0))
-                    + vdv * ((double)(-height/2 + y) + linearRand(0.0, 1.0));
+                    + vdu * ((double)(-width/2 + x) + offset.x)
+                    + vdv * ((double)(-height/2 + y) + offset.y);
     ray.direction = normalize(ray.direction);
     return ray;
   }
@@ -135,19 +143,13 @@ struct Sphere {
 
 /*!
  * Generate a normalized vector that sits on the surface of a half-sphere which is defined using a normal. Used to generate random diffuse reflections.
+ * Directions are cosine weighted so directions close to the normal are more likely, same as light reflected by a diffuse surface.
  * @param normal Normal that defines the dome/half-sphere direction
+ * @param u Two uniform numbers in the <0, 1) range
  * @return Random 3D vector on the dome surface
  */
-inline dvec3 RandomDome(const dvec3 &normal) {
-  double d;
-  dvec3 p;
-
-  do {
-    p = sphericalRand(1.0);
-    d = dot(p, normal);
-  } while(d < 0);
-
-  return p;
+inline dvec3 RandomDome(const dvec3 &normal, const dvec2 &u) {
+  return cosineHemisphere(normal, u);
 }
 
 /*!
@@ -218,28 +220,102 @@ struct World {
   }
 
   /*!
-   * Render the world to the provided image
-   * @param image Image to render to
+   * Compute the average color of all samples of a single pixel
+   * @param x Horizontal position of the pixel
+   * @param y Vertical position of the pixel
+   * @param width Width of the image
+   * @param height Height of the image
+   * @param samples Number of samples per pixel
+   * @param sampler Sampler that provides the sample positions
+   * @return Color of the pixel
    */
-  void render(Image& image, unsigned int samples) const {
-    // Render section of the framebuffer
-    for(int y = 0; y < image.height; ++y) {
-      for (int x = 0; x < image.width; ++x) {
-        dvec3 color;
-        for (unsigned int i = 0; i < samples; i++) {
-          auto ray = camera.generateRay(x, y, image.width, image.height);
-          color = color + trace(ray);
-        }
-        color = color / (double) samples;
-        image.setPixel(x, y, (float) color.r, (float) color.g, (float) color.b);
-      }
+  dvec3 renderPixel(int x, int y, int width, int height, unsigned int samples, const Sampler &sampler) const {
+    dvec3 color;
+    for (unsigned int i = 0; i < samples; i++) {
+      // Samples are identified by pixel and index so the result is independent of the thread count
+      SampleStream sample{sampler, (uint32_t) x, (uint32_t) y, i};
+      auto ray = camera.generateRay(x, y, width, height, sample);
+      color = color + trace(ray);
     }
+    return color / (double) samples;
+  }
+
+  /*!
+   * Render the world to the provided image
+   * @param image Floating point image to render to
+   * @param samples Number of samples per pixel
+   * @param sampler Sampler that provides the sample positions
+   * @param scheduler Scheduler that distributes image tiles between threads
+   */
+  void render(FloatImage& image, unsigned int samples, const Sampler &sampler, TileScheduler &scheduler) const {
+    // Render tiles of the framebuffer
+    scheduler.run(image.width, image.height, [&](const Tile &tile) {
+      for(int y = tile.y; y < tile.y + tile.height; ++y)
+        for (int x = tile.x; x < tile.x + tile.width; ++x)
+          image.setPixel(x, y, vec3{renderPixel(x, y, image.width, image.height, samples, sampler)});
+    });
+  }
+
+  /*!
+   * Render the world and write every finished tile to a file, only the tiles being rendered are kept in memory
+   * @param writer Writer of the output file, its size is the size of the rendered image
+   * @param samples Number of samples per pixel
+   * @param sampler Sampler that provides the sample positions
+   * @param scheduler Scheduler that distributes image tiles between threads
+   */
+  void render(ImageWriter& writer, unsigned int samples, const Sampler &sampler, TileScheduler &scheduler) const {
+    // Tile images are recycled, only the tiles in flight are allocated
+    FloatImagePool hdrTiles;
+    ImagePool ldrTiles;
+    scheduler.run(writer.width, writer.height, [&](const Tile &tile) {
+      auto hdr = hdrTiles.lease(tile.width, tile.height);
+      for(int y = tile.y; y < tile.y + tile.height; ++y)
+        for (int x = tile.x; x < tile.x + tile.width; ++x)
+          hdr->setPixel(x - tile.x, y - tile.y, vec3{renderPixel(x, y, writer.width, writer.height, samples, sampler)});
+
+      auto ldr = ldrTiles.lease(tile.width, tile.height);
+      tonemap::apply(*hdr, *ldr, tonemap::Operator::Clamp);
+      writer.writeTile(tile, *ldr);
+    });
   }
 };
 
-int main() {
-  // Image to render to
-  Image image {512, 512};
+int main(int argc, char *argv[]) {
+  // Command line options
+  unsigned int threads = 0;
+  int tileSize = 16;
+  bool tileStatistics = false;
+  string samplerName = "sobol";
+  int size = 512;
+  bool stream = false;
+  auto usage = [&] {
+    cerr << "Usage: " << argv[0] << " [--threads <count>] [--tile-size <pixels>] [--tile-stats]"
+         << " [--sampler random|stratified|halton|sobol|bluenoise] [--size <pixels>] [--stream]" << endl;
+    return EXIT_FAILURE;
+  };
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+        threads = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc) {
+        tileSize = stoi(argv[++i]);
+      } else if (strcmp(argv[i], "--tile-stats") == 0) {
+        tileStatistics = true;
+      } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && Sampler::isKnown(argv[i + 1])) {
+        samplerName = argv[++i];
+      } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+        size = stoi(argv[++i]);
+        if (size <= 0) return usage();
+      } else if (strcmp(argv[i], "--stream") == 0) {
+        stream = true;
+      } else {
+        return usage();
+      }
+    }
+  } catch (const exception &) {
+    // Numbers that do not parse or do not fit
+    return usage();
+  }
 
   // World to render
   const World world = {
@@ -266,10 +342,24 @@ int main() {
   };
 
   // Render the scene
-  world.render(image, 4);
-
-  // Save the result
-  image::saveBMP(image, "raw2_raycast.bmp");
+  const unsigned int samples = 4;
+  auto sampler = Sampler::create(samplerName, samples);
+  TileScheduler scheduler{threads, tileSize};
+  if (stream) {
+    // Tiles are tone mapped and written as soon as they are done
+    ImageWriter writer{"raw2_raycast.bmp", size, size, ImageWriter::Format::BMP};
+    world.render(writer, samples, *sampler, scheduler);
+    writer.close();
+  } else {
+    FloatImage hdr{size, size};
+    world.render(hdr, samples, *sampler, scheduler);
+
+    // Convert to 8 bits only once all samples are averaged and save the result
+    Image image{size, size};
+    tonemap::apply(hdr, image, tonemap::Operator::Clamp);
+    image::saveBMP(image, "raw2_raycast.bmp");
+  }
+  if (tileStatistics) scheduler.printStatistics(cout);
 
   cout << "Done." << endl;
   return EXIT_SUCCESS;
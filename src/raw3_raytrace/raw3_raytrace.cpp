@@ -1,10 +1,27 @@
 // Example raw3_raytrace
-// - Simple demonstration of raytracing/pathtracing without any acceleration techniques
+// - Simple demonstration of raytracing/pathtracing
 // - Casts rays from camera space into scene and recursively traces reflections/refractions
 // - Materials are extended to support simple specular reflections and transparency with refraction index
+// - Ray to scene collisions are accelerated using a bounding volume hierarchy, use --brute-force to compare
+// - Spheres in the hierarchy leaves are tested using SSE2/AVX2 kernels selected by CPU, see --kernel
+// - Samples are accumulated in passes, optional periodic checkpoints let the render be stopped and resumed
+// - Paths are traced iteratively and terminated by Russian roulette, use --recursive for the fixed depth tracer
+// - Image tiles are rendered in parallel using a work stealing thread pool
+// - Triangle meshes loaded from OBJ files are traced using a watertight intersection, see --obj
+// - The image is kept in floating point, saved as PFM and tone mapped to BMP, see --tonemap
+// - Sample positions come from scrambled Sobol sequence by default, see --sampler for other samplers
 
 #include <iostream>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <stdexcept>
+#include <csignal>
+#include <atomic>
+#include <sstream>
 #include <ppgso/ppgso.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/component_wise.hpp>
 
 using namespace std;
 using namespace glm;
@@ -14,6 +31,10 @@ using namespace ppgso;
 constexpr double INF = numeric_limits<double>::max();       // Will be used for infinity
 constexpr double EPS = numeric_limits<double>::epsilon();   // Numerical epsilon
 const double DELTA = sqrt(EPS);                             // Delta to use
+constexpr unsigned int MAX_DEPTH = 64;                      // Safety limit for paths terminated by Russian roulette
+
+// Number of rays cast by the current thread, collected per tile
+thread_local uint64_t castCount = 0;
 
 /*!
  * Structure holding origin and direction that represents a ray
@@ -66,9 +87,12 @@ struct Camera {
    * @param y Vertical position in the viewport
    * @param width Width of the viewport
    * @param height Height of the viewport
+   * @param sample Sample stream that provides the deviation
    * @return Ray for the giver viewport position with small random deviation applied to support multi-sampling
    */
-  Ray generateRay(int x, int y, int width, int height) const {
+  Ray generateRay(int x, int y, int width, int height, SampleStream &sample) const {
+    dvec2 offset = sample.get2D();
+
     // Camera deltas
     dvec3 vdu = 2.0 * right / (double)width;
     dvec3 vdv = 2.0 * -up / (double)height;
@@ -76,8 +100,8 @@ struct Camera {
     Ray ray;
     ray.origin = position;
     ray.direction = -back
-                  + vdu * ((double)(-width/2 + x) + linearRand(0.0, 1.0))
-                  + vdv * ((double)(-height/2 + y) + linearRand(0.0, 1.0));
+                  + vdu * ((double)(-width/2 + x) + offset.x)
+                  + vdv * ((double)(-height/2 + y) + offset.y);
     ray.direction = normalize(ray.direction);
     return ray;
   }
@@ -108,38 +132,48 @@ struct Sphere {
       double t = (-b - e) / a;
 
       if ( t > EPS ) {
-        dvec3 pt = ray.point(t);
-        dvec3 n = normalize(pt - center);
-        return {t, pt, n, material};
+        return hitAt(ray, t);
       }
 
       t = (-b + e) / a;
 
       if ( t > EPS ) {
-        dvec3 pt = ray.point(t);
-        dvec3 n = normalize(pt - center);
-        return {t, pt, n, material};
+        return hitAt(ray, t);
       }
     }
     return noHit;
   }
+
+  /*!
+   * Construct the Hit structure for a known collision distance
+   * @param ray Ray that collided with the sphere
+   * @param t Distance of the collision on the ray
+   * @return Hit structure that represents the collision
+   */
+  inline Hit hitAt(const Ray &ray, double t) const {
+    dvec3 pt = ray.point(t);
+    dvec3 n = normalize(pt - center);
+    return {t, pt, n, material};
+  }
+
+  /*!
+   * Compute bounding box of the sphere
+   * @return Axis aligned box enclosing the sphere
+   */
+  BoundingBox bounds() const {
+    return {center - radius, center + radius};
+  }
 };
 
 /*!
  * Generate a normalized vector that sits on the surface of a half-sphere which is defined using a normal. Used to generate random diffuse reflections.
+ * Directions are cosine weighted so directions close to the normal are more likely, same as light reflected by a diffuse surface.
  * @param normal Normal that defines the dome/half-sphere direction
+ * @param u Two uniform numbers in the <0, 1) range
  * @return Random 3D vector on the dome surface
  */
-inline dvec3 RandomDome(const dvec3 &normal) {
-  double d;
-  dvec3 p;
-
-  do {
-    p = sphericalRand(1.0);
-    d = dot(p, normal);
-  } while(d < 0);
-
-  return p;
+inline dvec3 RandomDome(const dvec3 &normal, const dvec2 &u) {
+  return cosineHemisphere(normal, u);
 }
 
 /*!
@@ -148,6 +182,46 @@ inline dvec3 RandomDome(const dvec3 &normal) {
 struct World {
   Camera camera;
   vector<Sphere> spheres;
+  BVH bvh;
+  SphereSet sphereSet;
+  TriangleSet triangles;
+  vector<Material> meshMaterials;
+  bool useBVH = true;
+  bool recursive = false;
+  unique_ptr<Sampler> sampler{new SobolSampler};
+  mutable atomic<uint64_t> rays{0};
+
+  /*!
+   * Create a world, the acceleration structures are filled by build
+   * @param camera Camera to render the world with
+   * @param spheres Spheres in the world
+   */
+  World(const Camera &camera, vector<Sphere> spheres) : camera{camera}, spheres{move(spheres)} {}
+
+  /*!
+   * Build the bounding volume hierarchy, spheres are reordered to match the leaves of the hierarchy
+   * and copied to a structure of arrays for the vectorized intersection kernels
+   */
+  void build() {
+    vector<BoundingBox> bounds;
+    bounds.reserve(spheres.size());
+    for (auto &sphere : spheres)
+      bounds.push_back(sphere.bounds());
+    bvh.build(bounds);
+
+    vector<Sphere> ordered;
+    ordered.reserve(spheres.size());
+    for (auto index : bvh.getIndices())
+      ordered.push_back(spheres[index]);
+    spheres = move(ordered);
+
+    sphereSet.clear();
+    for (auto &sphere : spheres)
+      sphereSet.add(sphere.center, sphere.radius);
+
+    // Triangles have their own hierarchy
+    triangles.build();
+  }
 
   /*!
    * Compute ray to object collision with any object in the world
@@ -155,24 +229,76 @@ struct World {
    * @return Hit or noHit structure which indicates the material and distance the ray has collided with
    */
   inline Hit cast(const Ray &ray) const {
-    Hit hit = noHit;
-    for (auto &sphere : spheres) {
-      auto lh = sphere.hit(ray);
+    castCount++;
+    double tMax = INF;
+    int closest = -1;
+    if (!useBVH) {
+      // Test all spheres
+      closest = sphereSet.intersect(ray.origin, ray.direction, 0, sphereSet.size(), EPS, tMax);
+    } else {
+      // Only test spheres in the leaves the ray passes through
+      bvh.traverse(ray.origin, ray.direction, tMax, [&](uint32_t first, uint32_t count, double &tMax) {
+        int index = sphereSet.intersect(ray.origin, ray.direction, first, count, EPS, tMax);
+        if (index >= 0) closest = index;
+      });
+    }
 
-      if (lh.distance < hit.distance) {
-        hit = lh;
-      }
+    // Triangles closer than the nearest sphere
+    uint32_t triangle;
+    if (triangles.intersect(ray.origin, ray.direction, EPS, tMax, triangle))
+      return {tMax, ray.point(tMax), triangles.getNormal(triangle), meshMaterials[triangles.getMaterial(triangle)]};
+
+    if (closest < 0) return noHit;
+    return spheres[closest].hitAt(ray, tMax);
+  }
+
+  /*!
+   * Generate the next ray of a path by refracting or reflecting the incoming ray at a collision
+   * @param ray Incoming ray
+   * @param hit Collision of the incoming ray
+   * @param next Output ray to continue the path with
+   * @param sample Sample stream to use, every collision takes the same number of dimensions
+   * @return Color the light arriving along the next ray is modulated with
+   */
+  inline dvec3 scatter(const Ray &ray, const Hit &hit, Ray &next, SampleStream &sample) const {
+    // Take all dimensions up front so the following collisions use the same dimensions regardless of the branch
+    double choice = sample.get1D();
+    dvec2 direction = sample.get2D();
+
+    // Decide to reflect or refract using linear random
+    if (choice < hit.material.transparency) {
+      // Flip normal if the ray is "inside" a sphere
+      dvec3 normal = dot(ray.direction, hit.normal) < 0 ? hit.normal : -hit.normal;
+      // Reverse the refraction index as well
+      double r_index = dot(ray.direction, hit.normal) < 0 ? 1/hit.material.refractionIndex : hit.material.refractionIndex;
+
+      // Prepare refraction ray
+      dvec3 refraction = refract(ray.direction, normal, r_index);
+      next = {hit.point - normal * DELTA, refraction};
+      // Modulate the refraction color with diffuse color
+      return lerp(hit.material.diffuse, {1,1,1}, hit.material.transparency);
+    } else {
+      // Calculate reflection on the side of the surface the ray came from, triangles can be hit from both sides
+      dvec3 normal = dot(ray.direction, hit.normal) < 0 ? hit.normal : -hit.normal;
+      // Random diffuse reflection
+      dvec3 diffuse = RandomDome(normal, direction);
+      // Ideal specular reflection
+      dvec3 reflection = reflect(ray.direction, normal);
+      // Ray that combines reflection direction depending on the material reflectivness
+      next = {hit.point + normal * DELTA, lerp(diffuse, reflection, hit.material.reflectivity)};
+      // Reflection color is white for specular reflections, otherwise diffuse color is used
+      return lerp(hit.material.diffuse, {1, 1, 1}, hit.material.reflectivity);
     }
-    return hit;
   }
 
   /*!
    * Trace a ray as it collides with objects in the world
    * @param ray Ray to trace
    * @param depth Maximum number of collisions to trace
+   * @param sample Sample stream to use
    * @return Color representing the accumulated lighting for each ray collision
    */
-  inline dvec3 trace(const Ray &ray, unsigned int depth) const {
+  inline dvec3 trace(const Ray &ray, unsigned int depth, SampleStream &sample) const {
     if (depth == 0) return {0, 0, 0};
 
     const Hit hit = cast(ray);
@@ -183,69 +309,261 @@ struct World {
     // Emission
     dvec3 color = hit.material.emission;
 
-    // Decide to reflect or refract using linear random
-    if (linearRand(0.0f, 1.0f) < hit.material.transparency) {
-      // Flip normal if the ray is "inside" a sphere
-      dvec3 normal = dot(ray.direction, hit.normal) < 0 ? hit.normal : -hit.normal;
-      // Reverse the refraction index as well
-      double r_index = dot(ray.direction, hit.normal) < 0 ? 1/hit.material.refractionIndex : hit.material.refractionIndex;
+    // Trace the reflected or refracted ray recursively
+    Ray next;
+    dvec3 attenuation = scatter(ray, hit, next, sample);
+    color += attenuation * trace(next, depth - 1, sample);
 
-      // Prepare refraction ray
-      dvec3 refraction = refract(ray.direction, normal, r_index);
-      Ray refractionRay{hit.point - normal * DELTA, refraction};
-      // Modulate the refraction color with diffuse color
-      dvec3 refractionColor = lerp(hit.material.diffuse, {1,1,1}, hit.material.transparency);
-      // Trace the ray recursively
-      color += refractionColor * trace(refractionRay, depth - 1);
-    } else {
-      // Calculate reflection
-      // Random diffuse reflection
-      dvec3 diffuse = RandomDome(hit.normal);
-      // Ideal specular reflection
-      dvec3 reflection = reflect(ray.direction, hit.normal);
-      // Ray that combines reflection direction depending on the material reflectivness
-      Ray reflectedRay{hit.point + hit.normal * DELTA, lerp(diffuse, reflection, hit.material.reflectivity)};
-      // Reflection color is white for specular reflections, otherwise diffuse color is used
-      dvec3 reflectionColor = lerp(hit.material.diffuse, {1, 1, 1}, hit.material.reflectivity);
-      // Trace the ray recursively
-      color += reflectionColor * trace(reflectedRay, depth - 1);
+    return color;
+  }
+
+  /*!
+   * Trace a path iteratively, the path is terminated randomly using Russian roulette instead of a fixed depth.
+   * Paths that carry little light are likely to end early, surviving paths are weighted up to keep the result unbiased.
+   * @param ray Ray to start the path with
+   * @param rouletteDepth Number of collisions to trace before Russian roulette is applied
+   * @param sample Sample stream to use
+   * @return Color representing the accumulated lighting for each ray collision
+   */
+  inline dvec3 traceIterative(Ray ray, unsigned int rouletteDepth, SampleStream &sample) const {
+    dvec3 color{0, 0, 0};
+    dvec3 throughput{1, 1, 1};
+
+    for (unsigned int depth = 0; depth < MAX_DEPTH; ++depth) {
+      const Hit hit = cast(ray);
+
+      // No hit
+      if ( std::isinf(hit.distance)) break;
+
+      // Emission weighted by the light carried along the path so far
+      color += throughput * hit.material.emission;
+
+      Ray next;
+      throughput *= scatter(ray, hit, next, sample);
+      ray = next;
+
+      // Russian roulette, survival probability follows the strongest throughput channel
+      if (depth + 1 >= rouletteDepth) {
+        double survival = glm::min(.95, compMax(throughput));
+        if (sample.get1D() >= survival) break;
+        throughput /= survival;
+      }
     }
 
     return color;
   }
 
   /*!
-   * Render the world to the provided image
-   * @param image Image to render to
+   * Render one pass of samples and add them to the accumulation buffer
+   * @param buffer Accumulation buffer to add samples to
+   * @param samples Number of samples per pixel to add in this pass
+   * @param depth Maximum number of collisions to trace, or collisions before Russian roulette for iterative tracing
+   * @param scheduler Scheduler that distributes image tiles between threads
    */
-  void render(Image& image, unsigned int samples, unsigned int depth) const {
-    // For each pixel generate rays
-    #pragma omp parallel for
-    for (int y = 0; y < image.height; ++y) {
-      for (int x = 0; x < image.width; ++x) {
-        dvec3 color;
-
-        // Generate multiple samples
-        for (unsigned int i = 0; i < samples; ++i) {
-          auto ray = camera.generateRay(x, y, image.width, image.height);
-          color = color + trace(ray, depth);
+  void render(AccumulationBuffer &buffer, unsigned int samples, unsigned int depth, TileScheduler &scheduler) const {
+    // For each pixel in a tile generate rays
+    scheduler.run(buffer.width, buffer.height, [&](const Tile &tile) {
+      castCount = 0;
+      for (int y = tile.y; y < tile.y + tile.height; ++y) {
+        for (int x = tile.x; x < tile.x + tile.width; ++x) {
+          // Generate multiple samples, each identified by its index so passes and thread counts do not change the result
+          unsigned int first = buffer.getSamples(x, y);
+          for (unsigned int i = first; i < first + samples; ++i) {
+            SampleStream sample{*sampler, (uint32_t) x, (uint32_t) y, i};
+            auto ray = camera.generateRay(x, y, buffer.width, buffer.height, sample);
+            buffer.add(x, y, recursive ? trace(ray, depth, sample) : traceIterative(ray, depth, sample));
+          }
         }
-        // Collect the data
-        color = clamp(color / (double) samples, 0.0, 1.0);
-        image.setPixel(x, y, (float)color.r, (float)color.g, (float)color.b);
       }
-    }
+      rays += castCount;
+    });
+    buffer.nextPass();
   }
 };
 
-int main() {
+/*!
+ * Add randomly placed small spheres to the world, the placement is deterministic for a given count
+ * @param world World to add the spheres to
+ * @param count Number of spheres to add
+ */
+void addRandomSpheres(World &world, unsigned int count) {
+  mt19937 generator{count};
+  uniform_real_distribution<double> position{-9.0, 9.0};
+  uniform_real_distribution<double> unit{0.0, 1.0};
+  for (unsigned int i = 0; i < count; ++i) {
+    double radius = .1 + .3 * unit(generator);
+    dvec3 center{position(generator), position(generator), -9.0 + 9.0 * unit(generator)};
+    dvec3 diffuse{unit(generator), unit(generator), unit(generator)};
+    world.spheres.push_back({radius, center, { {0, 0, 0}, diffuse, unit(generator) < .2 ? 1.0 : 0.0, 0, 0 } });
+  }
+}
+
+/*!
+ * Load a triangle mesh from an OBJ file and place it on the floor in front of the reflective sphere
+ * @param world World to add the mesh to
+ * @param obj_file OBJ file to load
+ * @param material Material of the whole mesh
+ */
+void addMesh(World &world, const string &obj_file, const Material &material) {
+  auto firstVertex = world.triangles.getVertexCount();
+  world.triangles.load(obj_file, (uint32_t) world.meshMaterials.size());
+  world.meshMaterials.push_back(material);
+
+  // Scale the mesh to fit a 6 units large box standing on the floor
+  BoundingBox bounds = world.triangles.getBounds(firstVertex);
+  dvec3 size = bounds.max - bounds.min;
+  double scale = 6.0 / glm::max(glm::max(size.x, size.y), glm::max(size.z, DELTA));
+  dvec3 center = bounds.center();
+  dmat4 matrix = translate(dmat4{1.0}, {5, -10 + size.y * scale / 2, 4})
+                 * glm::scale(dmat4{1.0}, dvec3{scale})
+                 * translate(dmat4{1.0}, -center);
+  world.triangles.transform(matrix, firstVertex);
+}
+
+/*!
+ * Compare the recursive fixed depth tracer with the iterative Russian roulette tracer on the same scene
+ * @param world World to render
+ * @param width Width of the rendered image in pixels
+ * @param height Height of the rendered image in pixels
+ * @param samples Number of samples per pixel
+ * @param depth Depth of the recursive tracer
+ * @param rouletteDepth Number of collisions before Russian roulette in the iterative tracer
+ * @param threads Number of threads to use
+ * @param tileSize Size of the rendered tiles
+ */
+void runBenchmark(World &world, int width, int height, unsigned int samples, unsigned int depth,
+                  unsigned int rouletteDepth, unsigned int threads, int tileSize) {
+  TileScheduler scheduler{threads, tileSize};
+  for (bool recursive : {true, false}) {
+    AccumulationBuffer buffer{width, height};
+    world.recursive = recursive;
+    world.rays = 0;
+
+    auto start = chrono::steady_clock::now();
+    world.render(buffer, samples, recursive ? depth : rouletteDepth, scheduler);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    // Efficiency is the inverse of noise times render time, higher is better
+    double variance = buffer.getMeanVariance();
+    cout << (recursive ? "Recursive, depth " + to_string(depth) : "Iterative, roulette after " + to_string(rouletteDepth))
+         << ": " << elapsed.count() << "s, " << world.rays / elapsed.count() / 1e6 << " Mrays/s, "
+         << (double) world.rays / (buffer.width * buffer.height * samples) << " rays/sample, mean variance "
+         << variance << ", efficiency " << 1.0 / (variance * elapsed.count()) << endl;
+  }
+}
+
+// Set when the user asks the program to stop, the render loop saves a checkpoint and exits
+volatile sig_atomic_t interrupted = 0;
+
+int main(int argc, char *argv[]) {
+  // Command line options
+  bool bruteForce = false;
+  unsigned int extraSpheres = 0;
+  unsigned int samples = 64;
+  unsigned int passSamples = 4;
+  double timeLimit = 0;
+  double varianceLimit = 0;
+  string checkpoint = "raw3_raytrace.checkpoint";
+  double checkpointInterval = 60;
+  bool checkpointing = false;
+  bool resume = false;
+  unsigned int threads = 0;
+  int tileSize = 16;
+  bool tileStatistics = false;
+  bool recursive = false;
+  unsigned int depth = 5;
+  unsigned int rouletteDepth = 3;
+  bool benchmark = false;
+  uint64_t seed = 0;
+  string samplerName = "sobol";
+  string mesh;
+  tonemap::Operator toneMapping = tonemap::Operator::Clamp;
+  float exposure = 1.0f;
+  float gamma = 1.0f;
+  SphereSet::Kernel kernel = SphereSet::Kernel::Automatic;
+  auto usage = [&] {
+    cerr << "Usage: " << argv[0] << " [--brute-force] [--kernel auto|scalar|sse2|avx2] [--spheres <count>]"
+         << " [--samples <count>] [--pass-samples <count>] [--time-limit <seconds>] [--variance <threshold>]"
+         << " [--checkpoint <file>] [--checkpoint-interval <seconds>] [--resume]"
+         << " [--threads <count>] [--tile-size <pixels>] [--tile-stats]"
+         << " [--recursive] [--depth <count>] [--roulette-depth <count>] [--benchmark] [--seed <number>]"
+         << " [--sampler random|stratified|halton|sobol|bluenoise] [--obj <file>]"
+         << " [--tonemap clamp|reinhard|aces] [--exposure <scale>] [--gamma <gamma>]" << endl;
+    return EXIT_FAILURE;
+  };
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--brute-force") == 0) {
+        bruteForce = true;
+      } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+        string name = argv[++i];
+        if (name == "auto") kernel = SphereSet::Kernel::Automatic;
+        else if (name == "scalar") kernel = SphereSet::Kernel::Scalar;
+        else if (name == "sse2") kernel = SphereSet::Kernel::SSE2;
+        else if (name == "avx2") kernel = SphereSet::Kernel::AVX2;
+        else return usage();
+      } else if (strcmp(argv[i], "--spheres") == 0 && i + 1 < argc) {
+        extraSpheres = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+        samples = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--pass-samples") == 0 && i + 1 < argc) {
+        passSamples = std::max(1u, (unsigned int) stoul(argv[++i]));
+      } else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) {
+        timeLimit = stod(argv[++i]);
+      } else if (strcmp(argv[i], "--variance") == 0 && i + 1 < argc) {
+        varianceLimit = stod(argv[++i]);
+      } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+        checkpoint = argv[++i];
+        checkpointing = true;
+      } else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc) {
+        checkpointInterval = stod(argv[++i]);
+        checkpointing = true;
+      } else if (strcmp(argv[i], "--resume") == 0) {
+        resume = true;
+        checkpointing = true;
+      } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+        threads = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc) {
+        tileSize = stoi(argv[++i]);
+      } else if (strcmp(argv[i], "--tile-stats") == 0) {
+        tileStatistics = true;
+      } else if (strcmp(argv[i], "--recursive") == 0) {
+        recursive = true;
+      } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+        depth = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--roulette-depth") == 0 && i + 1 < argc) {
+        rouletteDepth = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--benchmark") == 0) {
+        benchmark = true;
+      } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+        seed = stoull(argv[++i]);
+      } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && Sampler::isKnown(argv[i + 1])) {
+        samplerName = argv[++i];
+      } else if (strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+        mesh = argv[++i];
+      } else if (strcmp(argv[i], "--tonemap") == 0 && i + 1 < argc) {
+        toneMapping = tonemap::parse(argv[++i]);
+      } else if (strcmp(argv[i], "--exposure") == 0 && i + 1 < argc) {
+        exposure = stof(argv[++i]);
+      } else if (strcmp(argv[i], "--gamma") == 0 && i + 1 < argc) {
+        gamma = stof(argv[++i]);
+      } else {
+        return usage();
+      }
+    }
+  } catch (const exception &) {
+    // Numbers or tone mapping operators that do not parse
+    return usage();
+  }
+
   cout << "This will take a while ..." << endl;
 
-  // Image to render to
+  // Linear image the samples are resolved to and the tone mapped image to display
+  FloatImage hdr{512, 512};
   Image image{512, 512};
 
   // World to render
-  const World world{
+  World world{
       { // Camera
           {  0,   0, 25}, // Position
           {  0,   0,  1}, // Back
@@ -264,12 +582,97 @@ int main() {
           {    10, {  10, 10, -10}, { { 0, 0, 0}, { 0, 0, 1}, 0, 0, 1.54 } },       // Sphere in top right corner
       },
   };
+  addRandomSpheres(world, extraSpheres);
+  if (!mesh.empty())
+    addMesh(world, mesh, { {0, 0, 0}, {.8, .8, .8}, .1, 0, 0 });
+
+  // Build acceleration structure
+  world.useBVH = !bruteForce;
+  world.sphereSet.setKernel(kernel);
+  world.recursive = recursive;
+  world.sampler = Sampler::create(samplerName, samples, seed);
+  world.build();
+
+  if (benchmark) {
+    runBenchmark(world, image.width, image.height, samples, depth, rouletteDepth, threads, tileSize);
+    return EXIT_SUCCESS;
+  }
 
-  // Render the scene
-  world.render(image, 64, 5);
+  // Options that change the samples, a checkpoint is only resumed with the same ones
+  stringstream settings;
+  settings << "seed " << seed << ", sampler " << samplerName << ", samples " << samples << ", spheres "
+           << extraSpheres << ", obj '" << mesh << "', " << (recursive ? "recursive depth " : "roulette depth ")
+           << (recursive ? depth : rouletteDepth);
+
+  // Continue from the last checkpoint if requested
+  AccumulationBuffer buffer{image.width, image.height};
+  buffer.setSettings(settings.str());
+  if (resume) {
+    try {
+      buffer = AccumulationBuffer::load(checkpoint);
+    } catch (const runtime_error &error) {
+      cerr << error.what() << endl;
+      return EXIT_FAILURE;
+    }
+    if (buffer.width != image.width || buffer.height != image.height) {
+      cerr << "Checkpoint " << checkpoint << " does not match the image size" << endl;
+      return EXIT_FAILURE;
+    }
+    if (buffer.getSettings() != settings.str()) {
+      cerr << "Checkpoint " << checkpoint << " was rendered with " << buffer.getSettings()
+           << ", it can not be resumed with " << settings.str() << endl;
+      return EXIT_FAILURE;
+    }
+    cout << "Resuming from " << checkpoint << " with " << buffer.getSamples(0, 0) << " samples" << endl;
+  }
+
+  // Save preview image and the checkpoint when checkpoints are in use
+  auto save = [&] {
+    if (checkpointing) buffer.save(checkpoint);
+    buffer.resolve(hdr);
+    image::savePFM(hdr, "raw3_raytrace.pfm");
+    tonemap::apply(hdr, image, toneMapping, exposure, gamma);
+    image::saveBMP(image, "raw3_raytrace.bmp");
+  };
+
+  // Stop at the end of the current pass on Ctrl+C
+  signal(SIGINT, [](int) { interrupted = 1; });
+
+  // Render the scene in passes until the sample count, time or variance limit is reached
+  TileScheduler scheduler{threads, tileSize};
+  auto start = chrono::steady_clock::now();
+  auto lastCheckpoint = start;
+  // Every pass adds the same number of samples to all pixels
+  while (buffer.getSamples(0, 0) < samples && !interrupted) {
+    world.render(buffer, std::min(passSamples, samples - buffer.getSamples(0, 0)),
+                 recursive ? depth : rouletteDepth, scheduler);
+
+    auto now = chrono::steady_clock::now();
+    chrono::duration<double> elapsed = now - start;
+    chrono::duration<double> sinceCheckpoint = now - lastCheckpoint;
+    if (checkpointInterval > 0 && sinceCheckpoint.count() >= checkpointInterval) {
+      save();
+      lastCheckpoint = now;
+    }
+
+    if (timeLimit > 0 && elapsed.count() >= timeLimit) {
+      cout << "Time limit reached" << endl;
+      break;
+    }
+    if (varianceLimit > 0 && buffer.getMaxVariance() <= varianceLimit) {
+      cout << "Variance limit reached" << endl;
+      break;
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Rendered " << world.spheres.size() << " spheres and " << world.triangles.size() << " triangles using "
+       << (bruteForce ? "brute-force" : "BVH with " + world.sphereSet.getKernelName() + " kernel")
+       << " traversal on " << scheduler.getThreadCount() << " threads in " << elapsed.count() << "s, "
+       << buffer.getPasses() << " passes" << endl;
+  if (tileStatistics) scheduler.printStatistics(cout);
 
   // Save the result
-  image::saveBMP(image, "raw3_raytrace.bmp");
+  save();
 
   cout << "Done." << endl;
   return EXIT_SUCCESS;
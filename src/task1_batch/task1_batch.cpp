@@ -0,0 +1,104 @@
+// Task 1 batch - Apply a per-pixel filter to many BMP or RAW images at once
+//              - Images are loaded, filtered and saved by a pipeline so file I/O overlaps with filtering
+//              - Output files keep the name of the input file and are stored in the output directory
+//              - The format of each file is selected by its extension, RAW images are 512x512 unless --raw-size is used
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+#include <chrono>
+#include <ppgso/ppgso.h>
+
+using namespace std;
+using namespace ppgso;
+
+/*!
+ * Get the file name without the directory
+ * @param path Path to a file
+ * @return Name of the file
+ */
+string fileName(const string &path) {
+  auto separator = path.find_last_of("/\\");
+  return separator == string::npos ? path : path.substr(separator + 1);
+}
+
+/*!
+ * Get per-pixel filter by name
+ * @param name One of none, invert or grayscale
+ * @return Filter to apply to each image
+ */
+ImagePipeline::Process getFilter(const string &name) {
+  if (name == "none") return {};
+  if (name == "invert") {
+    return [](Image &image) {
+      for (auto &pixel : image.getFramebuffer())
+        pixel = {(uint8_t) (255 - pixel.r), (uint8_t) (255 - pixel.g), (uint8_t) (255 - pixel.b)};
+    };
+  }
+  if (name == "grayscale") {
+    return [](Image &image) {
+      for (auto &pixel : image.getFramebuffer()) {
+        auto gray = (uint8_t) ((pixel.r * 77 + pixel.g * 150 + pixel.b * 29) >> 8);
+        pixel = {gray, gray, gray};
+      }
+    };
+  }
+  throw runtime_error("Unknown filter " + name + ", use none, invert or grayscale.");
+}
+
+int main(int argc, char *argv[]) {
+  // Command line options
+  unsigned int threads = 0;
+  size_t queueSize = 4;
+  int rawWidth = 512, rawHeight = 512;
+  string filterName = "invert";
+  vector<string> files;
+  auto usage = [&] {
+    cerr << "Usage: " << argv[0] << " [--threads <count>] [--queue <images>] [--raw-size <width> <height>]"
+         << " [--filter none|invert|grayscale] <output directory> <input files>..." << endl;
+    return EXIT_FAILURE;
+  };
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+        threads = (unsigned int) stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+        queueSize = stoul(argv[++i]);
+      } else if (strcmp(argv[i], "--raw-size") == 0 && i + 2 < argc) {
+        rawWidth = stoi(argv[++i]);
+        rawHeight = stoi(argv[++i]);
+        if (rawWidth <= 0 || rawHeight <= 0) return usage();
+      } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+        filterName = argv[++i];
+      } else if (argv[i][0] != '-') {
+        files.emplace_back(argv[i]);
+      } else {
+        return usage();
+      }
+    }
+  } catch (const exception &) {
+    // Numbers that do not parse or do not fit
+    return usage();
+  }
+  if (files.size() < 2) return usage();
+
+  // First file argument is the output directory
+  vector<ImagePipeline::Job> jobs;
+  for (size_t i = 1; i < files.size(); ++i)
+    jobs.push_back({files[i], files[0] + "/" + fileName(files[i])});
+
+  ImagePipeline pipeline{threads, queueSize};
+  pipeline.setRawSize(rawWidth, rawHeight);
+
+  cout << "Processing " << jobs.size() << " images ..." << endl;
+  auto start = chrono::steady_clock::now();
+  try {
+    pipeline.run(jobs, getFilter(filterName));
+  } catch (const runtime_error &error) {
+    cerr << error.what() << endl;
+    return EXIT_FAILURE;
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  cout << "Done in " << elapsed.count() << " s, " << jobs.size() / elapsed.count() << " images per second." << endl;
+  return EXIT_SUCCESS;
+}